@@ -7,7 +7,9 @@
 #include <ctime>
 #include <iostream>
 #include "AlarmClock.h" // To test other implementations, change this to #include<header file> or #inlcude<AlarmClock.h.old> for example
+#include "TimeStats.h"
 #include <chrono>
+#include <string>
 #include <thread>
 using namespace std;
 using namespace std::chrono;
@@ -86,6 +88,29 @@ void testReset(unsigned int sleep_time, int reset_portion=-1) {
    cout << "\tTime Spent Sleeping: " << slept_time << " us" << endl;
 }
 
+// Re-arms the same alarm many times and records how late the expiry is
+// observed compared to the deadline, for one wait policy
+void testOvershoot(const std::string& name, const AlarmWaitPolicy& policy, unsigned int sleep_time, int rounds) {
+   AlarmClock<microseconds> alerter(sleep_time, policy);
+   TimeStats overshoot;
+   overshoot.EnableHistogram();
+   for (int round = 0; round < rounds; ++round) {
+      auto deadline = steady_clock::now() + microseconds(sleep_time);
+      alerter.ArmAt(deadline);
+      WaitForAlarmClockToExpire(alerter);
+      overshoot.Save(duration_cast<nanoseconds>(steady_clock::now() - deadline).count());
+   }
+
+   const long long p50 = overshoot.Percentile(50);
+   const long long p99 = overshoot.Percentile(99);
+   TimeStats::Metrics metrics = overshoot.FlushAsMetrics();
+   cout << "Results (" << name << "):" << endl;
+   cout << "\tOvershoot min: " << std::get<TimeStats::MinTime>(metrics) / 1000.0 << " us" << endl;
+   cout << "\tOvershoot p50: " << p50 / 1000.0 << " us" << endl;
+   cout << "\tOvershoot p99: " << p99 / 1000.0 << " us" << endl;
+   cout << "\tOvershoot max: " << std::get<TimeStats::MaxTime>(metrics) / 1000.0 << " us" << endl;
+}
+
 int main(int, const char**) {
    // The tester could take in different values as arguments, for now I have
    // some hard coded. 
@@ -119,4 +144,11 @@ int main(int, const char**) {
    cout << "---------------------------- Testing " << s.count() << " seconds ----------------------------" << endl;
    getSleepOverhead(microseconds(s).count());
 
+   cout << "Overshoot Per Wait Policy" << endl;
+   const int kRounds = 200;
+   cout << "---------------------------- Testing " << us.count() << " microseconds ----------------------------" << endl;
+   testOvershoot("sleep", AlarmWaitPolicy::Sleeping(), us.count(), kRounds);
+   testOvershoot("hybrid, 200 us guard", AlarmWaitPolicy::Hybrid(microseconds(200)), us.count(), kRounds);
+   testOvershoot("hybrid, 200 us guard, cpu 0", AlarmWaitPolicy::Hybrid(microseconds(200), 0), us.count(), kRounds);
+   testOvershoot("spin", AlarmWaitPolicy::Spinning(), us.count(), kRounds);
 }
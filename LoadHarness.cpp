@@ -0,0 +1,89 @@
+/*
+ * File:   LoadHarness.cpp
+ * Description: Drives a simulated service with the open loop LoadGenerator
+ *    and compares it with the closed loop TriggerTimeStats measurement of
+ *    the same service. The service takes ~20 us per call and stalls for
+ *    10 ms every 100 ms, the closed loop numbers hide most of that stall.
+ *
+ *    usage: LoadHarness [rate/s] [seconds] [issuers] [p99 SLO in us]
+ *    With an SLO the harness also sweeps for the highest rate within it.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include "LoadGenerator.h"
+#include "TscClock.h"
+#include "TriggerTimeStats.h"
+using namespace std;
+
+namespace {
+   const long long kServiceNs = 20000;
+   const long long kStallEveryNs = 100000000;
+   const long long kStallNs = 10000000;
+
+   struct SimulatedService {
+      SimulatedService() : mNextStallNs(kStallEveryNs) {}
+
+      void operator()() {
+         long long now = static_cast<long long>(mClock.ElapsedNs());
+         long long next = mNextStallNs.load();
+         if (now >= next && mNextStallNs.compare_exchange_strong(next, next + kStallEveryNs)) {
+            this_thread::sleep_for(chrono::nanoseconds(kStallNs));
+         }
+         TscStopWatch busy;
+         while (static_cast<long long>(busy.ElapsedNs()) < kServiceNs) {
+         }
+      }
+
+      TscStopWatch mClock;
+      atomic<long long> mNextStallNs;
+   };
+
+   void ClosedLoop(double seconds) {
+      SimulatedService service;
+      TimeStats stats;
+      stats.EnableHistogram();
+      TscStopWatch sw;
+      while (sw.ElapsedNs() < seconds * 1e9) {
+         TriggerTimeStats trigger(stats);
+         service();
+      }
+      cout << "Closed loop: " << stats.FlushAsString() << endl;
+   }
+}
+
+int main(int argc, const char** argv) {
+   double rate = argc > 1 ? atof(argv[1]) : 10000;
+   double seconds = argc > 2 ? atof(argv[2]) : 2;
+   size_t issuers = argc > 3 ? static_cast<size_t>(atoi(argv[3])) : 1;
+   long long sloUs = argc > 4 ? atoll(argv[4]) : 0;
+
+   cout << "TSC: " << TscClock::TicksPerSecond() / 1e9 << " GHz, invariant: " << (TscClock::Invariant() ? "yes" : "no") << endl;
+   ClosedLoop(seconds);
+
+   LoadGenerator<TscClock>::Config config;
+   config.ratePerSecond = rate;
+   config.duration = chrono::nanoseconds(static_cast<long long>(seconds * 1e9));
+   config.issuers = issuers;
+   SimulatedService service;
+   auto result = LoadGenerator<TscClock>::Run(config, [&] { service(); });
+   cout << "Open loop: " << result.FlushAsString() << endl;
+
+   if (sloUs > 0) {
+      LoadGenerator<TscClock>::SweepConfig sweep;
+      sweep.startRate = rate / 10;
+      sweep.maxRate = rate * 10;
+      sweep.sloNs = sloUs * 1000;
+      sweep.stepDuration = chrono::nanoseconds(static_cast<long long>(seconds * 1e9));
+      sweep.issuers = issuers;
+      auto outcome = LoadGenerator<TscClock>::Sweep(sweep, [&] { service(); });
+      for (const auto& step : outcome.steps) {
+         cout << "\tRate: " << static_cast<long long>(step.rate) << "/s, p" << sweep.sloPercentile << ": "
+              << step.percentileNs / 1000 << " us" << (step.withinSlo ? "" : " <- SLO broken") << endl;
+      }
+      cout << "Highest rate within the SLO: " << static_cast<long long>(outcome.maxRateWithinSlo) << "/s" << endl;
+   }
+   return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * File:   TimeStatsSpeedTest.cpp
+ * Description: Compares TimeStats::SaveBatch with calling TimeStats::Save
+ *    for each element of the batch
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "TimeStats.h"
+#include "StopWatch.h"
+using namespace std;
+
+namespace {
+   const size_t kRepeats = 50;
+
+   vector<int64_t> MakeBatch(size_t size) {
+      vector<int64_t> batch(size);
+      for (auto& ns : batch) {
+         ns = 1000 + rand() % 1000000;
+      }
+      return batch;
+   }
+
+   long long SaveLoopNs(const vector<int64_t>& batch, TimeStats& stats) {
+      PrecisionStopWatch sw;
+      for (size_t repeat = 0; repeat < kRepeats; ++repeat) {
+         for (auto ns : batch) {
+            stats.Save(ns);
+         }
+      }
+      return sw.ElapsedNs();
+   }
+
+   long long SaveBatchNs(const vector<int64_t>& batch, TimeStats& stats) {
+      PrecisionStopWatch sw;
+      for (size_t repeat = 0; repeat < kRepeats; ++repeat) {
+         stats.SaveBatch(batch.data(), batch.size());
+      }
+      return sw.ElapsedNs();
+   }
+
+   void Compare(size_t size) {
+      auto batch = MakeBatch(size);
+      TimeStats loop;
+      TimeStats batched;
+      // warm up caches and the kernel selection
+      SaveLoopNs(batch, loop);
+      SaveBatchNs(batch, batched);
+      loop.FlushAsMetrics();
+      batched.FlushAsMetrics();
+
+      auto loopNs = SaveLoopNs(batch, loop);
+      auto batchNs = SaveBatchNs(batch, batched);
+      bool same = (loop.FlushAsMetrics() == batched.FlushAsMetrics());
+      double elements = static_cast<double>(size * kRepeats);
+      cout << "---------------------------- Batch of " << size << " ----------------------------" << endl;
+      cout << "\tSave loop: " << loopNs / elements << " ns/element" << endl;
+      cout << "\tSaveBatch: " << batchNs / elements << " ns/element" << endl;
+      cout << "\tSpeedup: " << (batchNs > 0 ? static_cast<double>(loopNs) / batchNs : 0) << "x" << endl;
+      cout << "\tSame metrics: " << (same ? "yes" : "NO") << endl;
+   }
+}
+
+int main(int, const char**) {
+   srand(1);
+   cout << "SaveBatch kernel: " << TimeStats::BatchKernel() << endl;
+   for (size_t size : {16, 256, 4096, 65536, 1048576}) {
+      Compare(size);
+   }
+   return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * File:   AdaptiveTimeout.h
+ * Description: A timeout that follows the observed latency instead of
+ *    being a fixed constant, in the spirit of TCP retransmission timeout
+ *    estimation.
+ *
+ *    Observed durations go into a LatencyHistogram. Every `window`
+ *    observations the timeout is re-estimated as
+ *       clamp(percentile(previous + current window) * multiplier, min, max)
+ *    and the current window becomes the previous one. Latency older than
+ *    two windows is aged out, so the estimate follows shifts in both
+ *    directions. Until the first window is full the initial timeout is used.
+ *
+ *    Backoff() doubles the timeout (up to the max) after an expiry, until
+ *    the next estimate replaces it.
+ *
+ *    Every estimate is kept in a history ring for metrics. Observe,
+ *    Backoff and the history are for one thread. Timeout() and Arm() can
+ *    be used from any thread.
+ *
+ * Example usage:
+ *    AdaptiveTimeout<std::chrono::milliseconds>::Config config;
+ *    config.percentile = 99;
+ *    config.multiplier = 2;
+ *    config.minTimeout = std::chrono::milliseconds(5);
+ *    config.maxTimeout = std::chrono::milliseconds(2000);
+ *    AdaptiveTimeout<std::chrono::milliseconds> ackTimeout(config);
+ *
+ *    ackTimeout.Arm(alarm);                          // send the batch
+ *    if (alarm.Expired()) { ackTimeout.Backoff(); }  // retry
+ *    else { ackTimeout.Observe(ackStopWatch.ElapsedNs()); }
+ */
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "AlarmClock.h"
+#include "LatencyHistogram.h"
+#include "TimeStats.h"
+
+template<typename Duration> class AdaptiveTimeout {
+public:
+   struct Config {
+      Config() : percentile(99), multiplier(2), minTimeout(std::chrono::milliseconds(1)),
+         maxTimeout(std::chrono::seconds(10)), initialTimeout(std::chrono::seconds(1)),
+         window(1000), historySize(64) {}
+
+      double percentile;
+      double multiplier;
+      std::chrono::nanoseconds minTimeout;
+      std::chrono::nanoseconds maxTimeout;
+      std::chrono::nanoseconds initialTimeout;
+      size_t window; // observations per re-estimate
+      size_t historySize;
+   };
+
+   struct Estimate {
+      long long percentileNs; // 0 for the initial timeout and backoffs
+      long long timeoutNs;
+      uint64_t observations; // in the two windows behind the estimate
+   };
+
+   explicit AdaptiveTimeout(const Config& config)
+      : mConfig(config)
+      , mTimeoutNs(Clamp(config.initialTimeout.count()))
+      , mEstimates(0)
+      , mHistoryNext(0) {
+      mConfig.window = std::max<size_t>(1, mConfig.window);
+      mConfig.historySize = std::max<size_t>(1, mConfig.historySize);
+      mHistory.reserve(mConfig.historySize);
+      AddHistory(Estimate{0, mTimeoutNs.load(std::memory_order_relaxed), 0});
+   }
+
+   AdaptiveTimeout & operator=(const AdaptiveTimeout&) = delete;
+   AdaptiveTimeout(const AdaptiveTimeout&) = delete;
+
+   void Observe(long long ns) {
+      mCurrent.Record(ns);
+      if (mCurrent.Count() >= mConfig.window) {
+         Reestimate();
+      }
+   }
+
+   template<typename Rep, typename Period>
+   void Observe(std::chrono::duration<Rep, Period> elapsed) {
+      Observe(static_cast<long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+   }
+
+   // Doubles the timeout after an expiry, up to the max
+   void Backoff() {
+      const long long doubled = Clamp(mTimeoutNs.load(std::memory_order_relaxed) * 2);
+      mTimeoutNs.store(doubled, std::memory_order_relaxed);
+      AddHistory(Estimate{0, doubled, 0});
+   }
+
+   // The current timeout, rounded up to whole Duration units
+   Duration Timeout() const {
+      const std::chrono::nanoseconds ns(mTimeoutNs.load(std::memory_order_relaxed));
+      Duration timeout = std::chrono::duration_cast<Duration>(ns);
+      return (timeout < ns) ? timeout + Duration(1) : timeout;
+   }
+
+   std::chrono::nanoseconds TimeoutNs() const {
+      return std::chrono::nanoseconds(mTimeoutNs.load(std::memory_order_relaxed));
+   }
+
+   // Re-arms the alarm with the current timeout
+   template<typename Clock> void Arm(AlarmClock<Duration, Clock>& alarm) const {
+      alarm.Reset(static_cast<unsigned int>(Timeout().count()));
+   }
+
+   // The estimates, oldest first
+   std::vector<Estimate> History() const {
+      std::vector<Estimate> history;
+      history.reserve(mHistory.size());
+      for (size_t i = 0; i < mHistory.size(); ++i) {
+         history.push_back(mHistory[(mHistoryNext + i) % mHistory.size()]);
+      }
+      return history;
+   }
+
+   // Min, max, count, total and average of the timeouts in the history
+   TimeStats::Metrics HistoryAsMetrics() const {
+      TimeStats stats;
+      for (const auto& estimate : mHistory) {
+         stats.Save(estimate.timeoutNs);
+      }
+      return stats.FlushAsMetrics();
+   }
+
+   std::string AsString() const {
+      return "Timeout: " + std::to_string(mTimeoutNs.load(std::memory_order_relaxed) / 1000) + " us"
+             + ", p" + FormatPercentile(mConfig.percentile) + " x " + FormatPercentile(mConfig.multiplier)
+             + ", Estimates: " + std::to_string(mEstimates);
+   }
+
+private:
+   long long Clamp(long long ns) const {
+      return std::min<long long>(mConfig.maxTimeout.count(), std::max<long long>(mConfig.minTimeout.count(), ns));
+   }
+
+   void Reestimate() {
+      LatencyHistogram both = mPrevious;
+      both.Merge(mCurrent);
+      const long long percentile = both.Percentile(mConfig.percentile);
+      const long long timeout = Clamp(static_cast<long long>(percentile * mConfig.multiplier));
+      mTimeoutNs.store(timeout, std::memory_order_relaxed);
+      AddHistory(Estimate{percentile, timeout, both.Count()});
+      ++mEstimates;
+
+      std::swap(mPrevious, mCurrent);
+      mCurrent.Reset();
+   }
+
+   void AddHistory(const Estimate& estimate) {
+      if (mHistory.size() < mConfig.historySize) {
+         mHistory.push_back(estimate);
+         return;
+      }
+      mHistory[mHistoryNext] = estimate;
+      mHistoryNext = (mHistoryNext + 1) % mHistory.size();
+   }
+
+   static std::string FormatPercentile(double value) {
+      std::string text = std::to_string(value);
+      text.erase(text.find_last_not_of('0') + 1);
+      if (!text.empty() && text.back() == '.') {
+         text.pop_back();
+      }
+      return text;
+   }
+
+   Config mConfig;
+   std::atomic<long long> mTimeoutNs;
+   LatencyHistogram mPrevious;
+   LatencyHistogram mCurrent;
+   uint64_t mEstimates;
+   std::vector<Estimate> mHistory; // ring, mHistoryNext is the oldest once full
+   size_t mHistoryNext;
+};
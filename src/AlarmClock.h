@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   AlarmClock.h
  * Author: Amanda Carbonari
  * Created: January 5, 2016 4:35pm
@@ -6,7 +6,25 @@
  *    microsecond to see if any of the two interrupt atomics have been set to
  *    true (mReset, mExit). If they are it will stop it's sleep and then check
  *    to see if it was a reset or exit. If it was expired and not reset or exit it will sleep
- *    until mReset (or exit) is set to true and it can start sleeping again.  
+ *    until mReset (or exit) is set to true and it can start sleeping again.
+ *
+ *    The alarm can be re-armed on the same thread, either with a new relative
+ *    duration, Reset(newDuration), or with an absolute deadline, ArmAt(time_point).
+ *    Every arm bumps a generation counter. The alarm thread only flags the
+ *    alarm as expired if the generation it was sleeping for is still the current
+ *    one, so an expiry that races with a re-arm is discarded and the new arm wins.
+ *
+ *    How the alarm thread waits is set with an AlarmWaitPolicy. The default
+ *    sleeps in 25 us steps, which is cheap but overshoots the deadline by
+ *    50 - 150 us. The hybrid policy sleeps until a guard window before the
+ *    deadline and then spins on the clock with the pause instruction, which
+ *    gets the overshoot to a few us for the price of a busy core during the
+ *    guard window. The spin policy never sleeps. The alarm thread can be
+ *    pinned to a CPU, which makes most sense together with spinning.
+ *
+ *    The deadline is kept on the Clock template parameter, steady_clock by
+ *    default. With VirtualClock the alarm expires when the test advances the
+ *    virtual time past the deadline, without waiting for it in real time.
  */
 
 #pragma once
@@ -15,25 +33,68 @@
 #include <atomic>
 #include <functional>
 #include <iostream>
+#include <cstdint>
 #include "StopWatch.h"
 
-template<typename Duration> class AlarmClock {
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+struct AlarmWaitPolicy {
+   enum Mode { kSleep, kHybrid, kSpin };
+
+   // 25 us sleep steps, lowest CPU usage
+   static AlarmWaitPolicy Sleeping() {
+      return AlarmWaitPolicy(kSleep, std::chrono::microseconds(0), -1);
+   }
+
+   // sleep until guardWindow before the deadline, then spin
+   static AlarmWaitPolicy Hybrid(std::chrono::microseconds guardWindow = std::chrono::microseconds(200), int cpu = -1) {
+      return AlarmWaitPolicy(kHybrid, guardWindow, cpu);
+   }
+
+   // spin all the time, burns the (optionally pinned) core
+   static AlarmWaitPolicy Spinning(int cpu = -1) {
+      return AlarmWaitPolicy(kSpin, std::chrono::microseconds(0), cpu);
+   }
+
+   AlarmWaitPolicy(Mode waitMode, std::chrono::microseconds guard, int pinToCpu)
+      : mode(waitMode), guardWindow(guard), cpu(pinToCpu) {}
+
+   Mode mode;
+   std::chrono::microseconds guardWindow;
+   int cpu; // -1 means no CPU affinity
+};
+
+template<typename Duration, typename Clock = std::chrono::steady_clock> class AlarmClock {
 public:
    typedef std::chrono::microseconds microseconds;
+   typedef Clock clock;
+   typedef typename Clock::time_point time_point;
 
-   // The sleep function is passed in for the unit tests. 
-   AlarmClock(unsigned int sleepDuration, std::function<bool (unsigned int)> funcPtr = nullptr) : mExpired(false),
+   // The sleep function is passed in for the unit tests.
+   AlarmClock(unsigned int sleepDuration, std::function<bool (unsigned int)> funcPtr = nullptr) : mArmState(0),
       mExit(false),
       mReset(false),
-      kSleepTimeUsCount(ConvertToMicrosecondsCount(Duration(sleepDuration))),
-      mAlarmExpiredFunction(funcPtr) {
-         if (mAlarmExpiredFunction == nullptr) {
-            mAlarmExpiredFunction = [&](unsigned int sleepTime) -> bool
-            { 
-               return ExpireAtUs(sleepTime); 
-            }; 
-         }
-         mAlarmThread = std::thread(&AlarmClock::AlarmClockInterruptableThread, this);
+      mSleepTimeUsCount(ConvertToMicrosecondsCount(Duration(sleepDuration))),
+      mDeadlineNs(DeadlineFromNow(mSleepTimeUsCount.load())),
+      mAlarmExpiredFunction(funcPtr),
+      mWaitPolicy(AlarmWaitPolicy::Sleeping()) {
+         Start();
+      }
+
+   AlarmClock(unsigned int sleepDuration, const AlarmWaitPolicy& waitPolicy) : mArmState(0),
+      mExit(false),
+      mReset(false),
+      mSleepTimeUsCount(ConvertToMicrosecondsCount(Duration(sleepDuration))),
+      mDeadlineNs(DeadlineFromNow(mSleepTimeUsCount.load())),
+      mAlarmExpiredFunction(nullptr),
+      mWaitPolicy(waitPolicy) {
+         Start();
       }
 
    virtual ~AlarmClock() {
@@ -42,59 +103,186 @@ public:
          mAlarmThread.join();
       }
    }
-   
+
    bool Expired() {
-      return mExpired.load(std::memory_order_acquire);
+      return (mArmState.load(std::memory_order_acquire) & kExpiredBit) != 0;
    }
 
+   /**
+    * Re-arms the alarm with the current duration, counted from now
+    */
    void Reset() {
-      mReset.store(true, std::memory_order_release);
-      mExpired.store(false, std::memory_order_release);
+      Arm(mSleepTimeUsCount.load(std::memory_order_relaxed));
+   }
+
+   /**
+    * Re-arms the alarm with a new duration, counted from now. The alarm
+    * thread is reused, only the timeout changes.
+    */
+   void Reset(unsigned int sleepDuration) {
+      Arm(ConvertToMicrosecondsCount(Duration(sleepDuration)));
+   }
+
+   /**
+    * Re-arms the alarm to expire at an absolute deadline. A deadline in the
+    * past expires the alarm as soon as the alarm thread notices it.
+    */
+   void ArmAt(time_point deadline) {
+      auto left = std::chrono::duration_cast<microseconds>(deadline - clock::now()).count();
+      mSleepTimeUsCount.store(left > 0 ? static_cast<unsigned int>(left) : 0, std::memory_order_relaxed);
+      mDeadlineNs.store(ToNs(deadline), std::memory_order_relaxed);
+      BumpGeneration();
+   }
+
+   /**
+    * @return the time left until the alarm expires, zero if it has already expired
+    */
+   microseconds Remaining() {
+      if (Expired()) {
+         return microseconds(0);
+      }
+      auto left = mDeadlineNs.load(std::memory_order_acquire) - ToNs(clock::now());
+      return left > 0 ? std::chrono::duration_cast<microseconds>(std::chrono::nanoseconds(left)) : microseconds(0);
    }
 
    int SleepTimeUs() {
-      return kSleepTimeUsCount;
+      return mSleepTimeUsCount.load(std::memory_order_relaxed);
+   }
+
+   const AlarmWaitPolicy& WaitPolicy() const {
+      return mWaitPolicy;
    }
 
 protected:
 
    void AlarmClockInterruptableThread() {
       while(!mExit.load(std::memory_order_acquire)) {
-         if(mAlarmExpiredFunction(kSleepTimeUsCount)) {
-            mExpired.store(true, std::memory_order_release);
-            while (!mReset.load(std::memory_order_acquire) && !mExit.load(std::memory_order_acquire)) {
-               std::this_thread::sleep_for(microseconds(1));
+         // Clear the interrupt before reading the generation: an arm that
+         // happens after this point either shows up in the generation or
+         // leaves mReset set, which interrupts the sleep below.
+         mReset.store(false, std::memory_order_release);
+         const uint64_t armed = mArmState.load(std::memory_order_acquire) & ~kExpiredBit;
+         if(mAlarmExpiredFunction(mSleepTimeUsCount.load(std::memory_order_relaxed))) {
+            uint64_t expected = armed;
+            if (mArmState.compare_exchange_strong(expected, armed | kExpiredBit, std::memory_order_acq_rel)) {
+               while (!mReset.load(std::memory_order_acquire) && !mExit.load(std::memory_order_acquire)) {
+                  std::this_thread::sleep_for(microseconds(1));
+               }
             }
          }
-         mReset.store(false, std::memory_order_release);
       }
    }
 
+   bool ExpireAtDeadline() {
+      return ExpireAtNs(mDeadlineNs.load(std::memory_order_acquire));
+   }
+
+   // The relative wait of earlier versions, kept for subclasses written
+   // against it. Waits timeUsTillExpire from now, false if interrupted
    bool ExpireAtUs(unsigned int timeUsTillExpire) {
-      StopWatch sw;
+      return ExpireAtNs(ToNs(clock::now()) + static_cast<int64_t>(timeUsTillExpire) * 1000);
+   }
+
+   // Waits until deadline (ns since the clock's epoch), false if interrupted
+   bool ExpireAtNs(int64_t deadline) {
       // The loop introduces a 50 microsecond overhead because it accesses
-      // the two atomics. Therefore stopwatch is needed to ensure the alarm
-      // does not over sleep. 
-      while (sw.ElapsedUs() < timeUsTillExpire) {
+      // the two atomics. Therefore the deadline is checked against the clock
+      // to ensure the alarm does not over sleep.
+      const int64_t spinFrom = deadline - SpinWindowNs();
+      while (ToNs(clock::now()) < spinFrom) {
          std::this_thread::sleep_for(microseconds(25));
-         if (mReset.load(std::memory_order_acquire) || mExit.load(std::memory_order_acquire)) {
+         if (Interrupted()) {
+            return false;
+         }
+      }
+
+      while (ToNs(clock::now()) < deadline) {
+         CpuRelax();
+         if (Interrupted()) {
             return false;
          }
       }
 
       return true;
    }
-   
+
    unsigned int ConvertToMicrosecondsCount(Duration t) {
       return std::chrono::duration_cast<microseconds>(t).count();
    }
-   
+
 private:
+   void Start() {
+      if (mAlarmExpiredFunction == nullptr) {
+         mAlarmExpiredFunction = [&](unsigned int) -> bool
+         {
+            return ExpireAtDeadline();
+         };
+      }
+      mAlarmThread = std::thread(&AlarmClock::AlarmClockInterruptableThread, this);
+#if defined(__linux__)
+      if (mWaitPolicy.cpu >= 0) {
+         cpu_set_t cpus;
+         CPU_ZERO(&cpus);
+         CPU_SET(mWaitPolicy.cpu, &cpus);
+         // best effort, an invalid CPU leaves the thread unpinned
+         pthread_setaffinity_np(mAlarmThread.native_handle(), sizeof(cpus), &cpus);
+      }
+#endif
+   }
+
+   int64_t SpinWindowNs() const {
+      switch (mWaitPolicy.mode) {
+         case AlarmWaitPolicy::kSpin: return INT64_MAX / 2;
+         case AlarmWaitPolicy::kHybrid: return std::chrono::duration_cast<std::chrono::nanoseconds>(mWaitPolicy.guardWindow).count();
+         default: return 0;
+      }
+   }
+
+   bool Interrupted() const {
+      return mReset.load(std::memory_order_acquire) || mExit.load(std::memory_order_acquire);
+   }
+
+   static void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+      _mm_pause();
+#else
+      std::this_thread::yield();
+#endif
+   }
+
+   static const uint64_t kExpiredBit = 1;
+   static const uint64_t kGenerationStep = 2;
+
+   static int64_t ToNs(time_point tp) {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+   }
+
+   static int64_t DeadlineFromNow(unsigned int us) {
+      return ToNs(clock::now() + microseconds(us));
+   }
+
+   void Arm(unsigned int us) {
+      mSleepTimeUsCount.store(us, std::memory_order_relaxed);
+      mDeadlineNs.store(DeadlineFromNow(us), std::memory_order_relaxed);
+      BumpGeneration();
+   }
+
+   // Starts a new generation with the expired bit cleared, then interrupts
+   // the alarm thread so that it picks up the new deadline.
+   void BumpGeneration() {
+      uint64_t state = mArmState.load(std::memory_order_relaxed);
+      while (!mArmState.compare_exchange_weak(state, (state & ~kExpiredBit) + kGenerationStep,
+                                              std::memory_order_acq_rel)) {
+      }
+      mReset.store(true, std::memory_order_release);
+   }
 
-   std::atomic<bool> mExpired;
+   std::atomic<uint64_t> mArmState; // generation << 1 | expired
    std::atomic<bool> mExit;
    std::atomic<bool> mReset;
-   const unsigned int kSleepTimeUsCount;
+   std::atomic<unsigned int> mSleepTimeUsCount;
+   std::atomic<int64_t> mDeadlineNs;
    std::function<bool (unsigned int)> mAlarmExpiredFunction;
+   const AlarmWaitPolicy mWaitPolicy;
    std::thread mAlarmThread;
 };
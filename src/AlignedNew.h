@@ -0,0 +1,44 @@
+/*
+ * File:   AlignedNew.h
+ * Description: Heap allocation at the alignment of a class with alignas(64)
+ *    members. Before C++17 operator new only guarantees the alignment of
+ *    max_align_t (16 bytes), so a heap allocated object of such a class can
+ *    straddle cache lines and lose the false sharing protection. Deriving
+ *    from AlignedNew<64> gives the class an operator new that honours it.
+ *
+ * Example usage:
+ *    class Counters : public AlignedNew<64> {
+ *       alignas(64) std::atomic<uint64_t> mCount;
+ *    };
+ *    std::unique_ptr<Counters> counters(new Counters); // 64 byte aligned
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+template<size_t Alignment> struct AlignedNew {
+   static_assert(Alignment >= sizeof(void*) && (Alignment & (Alignment - 1)) == 0,
+                 "the alignment must be a power of two of at least the size of a pointer");
+
+   static void* operator new(size_t size) {
+      void* memory = nullptr;
+      if (posix_memalign(&memory, Alignment, size) != 0) {
+         throw std::bad_alloc();
+      }
+      return memory;
+   }
+
+   static void* operator new[](size_t size) {
+      return operator new(size);
+   }
+
+   static void operator delete(void* memory) noexcept {
+      free(memory);
+   }
+
+   static void operator delete[](void* memory) noexcept {
+      free(memory);
+   }
+};
@@ -0,0 +1,146 @@
+/*
+ * File:   AwaitableTimer.h
+ * Description: C++20 coroutine awaitables on top of TimerLoop. The awaiter is
+ *    the TimerLoop::Waiter itself and lives in the coroutine frame, so a
+ *    co_await does not allocate once the loop has warmed up.
+ *
+ *    co_await resumes on the TimerLoop thread and yields true if the timer
+ *    expired, false if it was cancelled.
+ *
+ * Example usage:
+ *    TimerLoop loop;
+ *    co_await SleepFor(loop, std::chrono::milliseconds(5));
+ *    co_await SleepUntil(loop, deadline);
+ *
+ *    // same Duration templating as AlarmClock, and cancellable
+ *    AwaitableTimer<std::chrono::milliseconds> timer(loop);
+ *    bool expired = co_await timer.SleepFor(250);
+ *    ...
+ *    timer.Cancel(); // from another coroutine on the same loop
+ *
+ *    An AwaitableTimer wakes one coroutine. A second co_await while one is
+ *    pending throws std::logic_error in the second coroutine.
+ */
+
+#pragma once
+#if !defined(__cpp_impl_coroutine)
+#error "AwaitableTimer.h requires C++20 coroutine support"
+#endif
+
+#include <coroutine>
+#include <chrono>
+#include <stdexcept>
+#include "TimerLoop.h"
+
+namespace timer_detail {
+   // Shared by the one-shot awaiters and AwaitableTimer
+   class SuspendingWaiter : public TimerLoop::Waiter {
+   public:
+      SuspendingWaiter() : mExpired(true) {}
+
+   protected:
+      // a wait that never suspends because its deadline is due counts as expired
+      void Suspend(TimerLoop& loop, TimerLoop::clock::time_point deadline, std::coroutine_handle<> handle) {
+         mExpired = true;
+         mHandle = handle;
+         loop.Schedule(*this, deadline);
+      }
+
+      void OnWake(bool expired) override {
+         mExpired = expired;
+         auto handle = mHandle;
+         mHandle = nullptr;
+         handle.resume();
+      }
+
+      bool mExpired;
+      std::coroutine_handle<> mHandle;
+   };
+
+   class DeadlineAwaiter : public SuspendingWaiter {
+   public:
+      DeadlineAwaiter(TimerLoop& loop, TimerLoop::clock::time_point deadline)
+         : mLoop(loop), mDeadline(deadline) {}
+
+      bool await_ready() const {
+         return mDeadline <= TimerLoop::clock::now();
+      }
+
+      void await_suspend(std::coroutine_handle<> handle) {
+         Suspend(mLoop, mDeadline, handle);
+      }
+
+      bool await_resume() const {
+         return mExpired;
+      }
+
+   private:
+      TimerLoop& mLoop;
+      TimerLoop::clock::time_point mDeadline;
+   };
+} // timer_detail
+
+
+template<typename Duration>
+timer_detail::DeadlineAwaiter SleepFor(TimerLoop& loop, Duration duration) {
+   return timer_detail::DeadlineAwaiter(loop, TimerLoop::clock::now() + duration);
+}
+
+inline timer_detail::DeadlineAwaiter SleepUntil(TimerLoop& loop, TimerLoop::clock::time_point deadline) {
+   return timer_detail::DeadlineAwaiter(loop, deadline);
+}
+
+
+template<typename Duration> class AwaitableTimer : public timer_detail::SuspendingWaiter {
+public:
+   class Awaiter {
+   public:
+      Awaiter(AwaitableTimer& timer, TimerLoop::clock::time_point deadline)
+         : mTimer(timer), mDeadline(deadline) {
+         mTimer.mExpired = true;
+      }
+
+      bool await_ready() const {
+         return mDeadline <= TimerLoop::clock::now();
+      }
+
+      // throws std::logic_error if another coroutine already waits on the timer
+      void await_suspend(std::coroutine_handle<> handle) {
+         if (mTimer.Pending()) {
+            throw std::logic_error("AwaitableTimer already has a waiting coroutine");
+         }
+         mTimer.Suspend(mTimer.mLoop, mDeadline, handle);
+      }
+
+      bool await_resume() const {
+         return mTimer.mExpired;
+      }
+
+   private:
+      AwaitableTimer& mTimer;
+      TimerLoop::clock::time_point mDeadline;
+   };
+
+   explicit AwaitableTimer(TimerLoop& loop) : mLoop(loop) {}
+
+   // sleeps for a count of Duration, like AlarmClock<Duration>
+   Awaiter SleepFor(unsigned int count) {
+      return Awaiter(*this, TimerLoop::clock::now() + Duration(count));
+   }
+
+   Awaiter SleepFor(Duration duration) {
+      return Awaiter(*this, TimerLoop::clock::now() + duration);
+   }
+
+   Awaiter SleepUntil(TimerLoop::clock::time_point deadline) {
+      return Awaiter(*this, deadline);
+   }
+
+   // Wakes the waiting coroutine with false. Must be called on the loop thread
+   bool Cancel() {
+      return mLoop.Cancel(*this);
+   }
+
+private:
+   TimerLoop& mLoop;
+};
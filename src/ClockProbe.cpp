@@ -0,0 +1,276 @@
+#include "ClockProbe.h"
+#include "TscClock.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+const size_t ClockProbe::kDefaultReads;
+const long long ClockProbe::kMaxResolutionNs;
+const bool AutoClock::is_steady;
+
+namespace {
+   const int kCrossCoreRounds = 20;
+   const size_t kMaxCrossCoreCpus = 64;
+
+   template<typename Clock> int64_t ReadNs() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+   }
+
+   typedef int64_t (*ReadFunction)();
+   const ReadFunction kReaders[ClockProbe::kSourceCount] = {
+      &ReadNs<std::chrono::steady_clock>,
+      &ReadNs<std::chrono::high_resolution_clock>,
+      &ReadNs<TscClock>
+   };
+
+   bool Available(ClockProbe::Source source) {
+#if defined(__x86_64__) || defined(__i386__)
+      return source != ClockProbe::kTsc || TscClock::Invariant();
+#else
+      return source != ClockProbe::kTsc; // TscClock is steady_clock here
+#endif
+   }
+
+   bool Steady(ClockProbe::Source source) {
+      switch (source) {
+         case ClockProbe::kSteady: return std::chrono::steady_clock::is_steady;
+         case ClockProbe::kHighResolution: return std::chrono::high_resolution_clock::is_steady;
+         default: return TscClock::Invariant();
+      }
+   }
+
+   // one decimal, e.g. "12.5"
+   std::string OneDecimal(double value) {
+      const long long tenths = static_cast<long long>(value * 10 + 0.5);
+      return std::to_string(tenths / 10) + "." + std::to_string(tenths % 10);
+   }
+
+   // Hops a thread over the allowed CPUs and checks that the clock never
+   // goes backwards from one CPU to the next. Needs the Linux affinity
+   // calls, elsewhere crossCoreChecked stays false
+   void ProbeCrossCore(ReadFunction read, ClockCharacteristics& result) {
+#ifdef __linux__
+      cpu_set_t allowed;
+      CPU_ZERO(&allowed);
+      if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) < 2) {
+         return;
+      }
+      std::vector<int> cpus;
+      for (int cpu = 0; cpu < CPU_SETSIZE && cpus.size() < kMaxCrossCoreCpus; ++cpu) {
+         if (CPU_ISSET(cpu, &allowed)) {
+            cpus.push_back(cpu);
+         }
+      }
+
+      uint64_t backwardSteps = 0;
+      long long maxSkew = 0;
+      bool hopped = false;
+      try {
+         // in its own thread, the caller's affinity is left alone
+         std::thread hopper([&] {
+            int64_t last = read();
+            for (int round = 0; round < kCrossCoreRounds; ++round) {
+               for (int cpu : cpus) {
+                  cpu_set_t one;
+                  CPU_ZERO(&one);
+                  CPU_SET(cpu, &one);
+                  if (pthread_setaffinity_np(pthread_self(), sizeof(one), &one) != 0) {
+                     continue;
+                  }
+                  hopped = true;
+                  const int64_t now = read();
+                  if (now < last) {
+                     ++backwardSteps;
+                     maxSkew = std::max<long long>(maxSkew, last - now);
+                  }
+                  last = std::max(last, now);
+               }
+            }
+         });
+         hopper.join();
+      } catch (const std::exception&) {
+         return; // no thread, not checked
+      }
+      result.crossCoreChecked = hopped;
+      result.crossCoreBackwardSteps = backwardSteps;
+      result.crossCoreMaxSkewNs = maxSkew;
+#else
+      (void)read;
+      (void)result;
+#endif
+   }
+
+   struct AutoClockState {
+      std::once_flag probeOnce;
+      std::mutex mutex;
+      std::vector<ClockCharacteristics> probed;
+      ClockProbe::Source selected = ClockProbe::kSteady;
+      std::atomic<int> source{ClockProbe::kSteady};
+      std::atomic<bool> overridden{false};
+   };
+
+   AutoClockState& State() {
+      // never destroyed, AutoClock may be read during exit
+      static AutoClockState* state = new AutoClockState;
+      return *state;
+   }
+}
+
+std::string ClockCharacteristics::AsString() const {
+   if (!available) {
+      return name + ": not available";
+   }
+   std::string str = name + ": Read: " + OneDecimal(readCostNs) + " ns"
+                     + ", Resolution: " + std::to_string(resolutionNs) + " ns"
+                     + (steady ? ", steady" : ", not steady")
+                     + ", Backward steps: " + std::to_string(backwardSteps);
+   if (crossCoreChecked) {
+      str += ", Cross-core backward steps: " + std::to_string(crossCoreBackwardSteps)
+             + ", Max skew: " + std::to_string(crossCoreMaxSkewNs) + " ns";
+   } else {
+      str += ", Cross-core: not checked";
+   }
+   return str;
+}
+
+const char* ClockProbe::Name(Source source) {
+   switch (source) {
+      case kSteady: return "steady_clock";
+      case kHighResolution: return "high_resolution_clock";
+      case kTsc: return "tsc";
+      default: return "unknown";
+   }
+}
+
+int64_t ClockProbe::Read(Source source) {
+   return kReaders[source]();
+}
+
+ClockCharacteristics ClockProbe::Probe(Source source, size_t reads) {
+   ClockCharacteristics result;
+   result.name = Name(source);
+   result.available = Available(source);
+   result.steady = Steady(source);
+   result.readCostNs = 0;
+   result.resolutionNs = 0;
+   result.backwardSteps = 0;
+   result.crossCoreChecked = false;
+   result.crossCoreBackwardSteps = 0;
+   result.crossCoreMaxSkewNs = 0;
+   if (!result.available) {
+      return result;
+   }
+   reads = std::max<size_t>(1, reads);
+   const ReadFunction read = kReaders[source];
+   read(); // warm up, e.g. the TSC calibration
+
+   // read cost, through a function pointer like AutoClock
+   volatile int64_t sink = 0;
+   int64_t sum = 0;
+   const auto start = std::chrono::steady_clock::now();
+   for (size_t i = 0; i < reads; ++i) {
+      sum += read();
+   }
+   const auto end = std::chrono::steady_clock::now();
+   sink = sum;
+   (void)sink;
+   result.readCostNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) / reads;
+
+   // resolution and backward steps
+   long long resolution = std::numeric_limits<long long>::max();
+   int64_t previous = read();
+   for (size_t i = 0; i < reads; ++i) {
+      const int64_t current = read();
+      if (current < previous) {
+         ++result.backwardSteps;
+      } else if (current > previous) {
+         resolution = std::min<long long>(resolution, current - previous);
+      }
+      previous = current;
+   }
+   result.resolutionNs = (resolution == std::numeric_limits<long long>::max()) ? 0 : resolution;
+
+   ProbeCrossCore(read, result);
+   return result;
+}
+
+std::vector<ClockCharacteristics> ClockProbe::ProbeAll(size_t reads) {
+   std::vector<ClockCharacteristics> probed;
+   for (int source = 0; source < kSourceCount; ++source) {
+      probed.push_back(Probe(static_cast<Source>(source), reads));
+   }
+   return probed;
+}
+
+ClockProbe::Source ClockProbe::Select(const std::vector<ClockCharacteristics>& probed) {
+   Source best = kSteady;
+   double bestCost = std::numeric_limits<double>::max();
+   for (size_t i = 0; i < probed.size() && i < kSourceCount; ++i) {
+      const ClockCharacteristics& clock = probed[i];
+      const bool qualifies = clock.available && clock.steady
+                             && clock.backwardSteps == 0 && clock.crossCoreBackwardSteps == 0
+                             && clock.resolutionNs > 0 && clock.resolutionNs <= kMaxResolutionNs;
+      if (qualifies && clock.readCostNs < bestCost) {
+         best = static_cast<Source>(i);
+         bestCost = clock.readCostNs;
+      }
+   }
+   return best;
+}
+
+std::atomic<AutoClock::ReadFunction> AutoClock::mRead(&ReadNs<std::chrono::steady_clock>);
+
+void AutoClock::Initialize() {
+   AutoClockState& state = State();
+   std::call_once(state.probeOnce, [&state] {
+      std::vector<ClockCharacteristics> probed = ClockProbe::ProbeAll();
+      const ClockProbe::Source selected = ClockProbe::Select(probed);
+      std::lock_guard<std::mutex> lock(state.mutex);
+      state.probed.swap(probed);
+      state.selected = selected;
+      // Use() may have picked a source already
+      if (!state.overridden) {
+         state.source = selected;
+         mRead.store(kReaders[selected]);
+      }
+   });
+}
+
+bool AutoClock::Use(ClockProbe::Source source) {
+   if (source < 0 || source >= ClockProbe::kSourceCount || !Available(source) || !Steady(source)) {
+      return false;
+   }
+   AutoClockState& state = State();
+   std::lock_guard<std::mutex> lock(state.mutex);
+   state.overridden = true;
+   state.source = source;
+   mRead.store(kReaders[source]);
+   return true;
+}
+
+ClockProbe::Source AutoClock::Source() {
+   return static_cast<ClockProbe::Source>(State().source.load());
+}
+
+std::string AutoClock::Report() {
+   const ClockProbe::Source source = Source();
+   AutoClockState& state = State();
+   std::lock_guard<std::mutex> lock(state.mutex);
+   std::string str = std::string("Clock source: ") + ClockProbe::Name(source);
+   if (state.overridden) {
+      str += " (set by Use";
+      str += state.probed.empty() ? ")" : std::string(", the probe selected ") + ClockProbe::Name(state.selected) + ")";
+   }
+   if (state.probed.empty() && !state.overridden) {
+      str += " (not probed, see AutoClock::Initialize)";
+   }
+   for (const auto& clock : state.probed) {
+      str += "\n\t" + clock.AsString();
+   }
+   return str;
+}
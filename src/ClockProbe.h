@@ -0,0 +1,119 @@
+/*
+ * File:   ClockProbe.h
+ * Description: Measures the clock sources of this host and picks the best
+ *    one for AutoClock, instead of guessing whether steady_clock,
+ *    high_resolution_clock or the TSC is cheapest and finest here. Which one
+ *    wins varies by kernel, VM and CPU: on some VMs clock_gettime falls back
+ *    to a syscall that costs hundreds of nanoseconds.
+ *
+ *    For each source the probe measures
+ *    - read cost: the average time of one now(), in a tight loop
+ *    - resolution: the smallest step seen between two reads
+ *    - monotonicity: how often a read went backwards in one thread
+ *    - cross-core consistency: a thread hops over the CPUs it may run on and
+ *      checks that the clock never goes backwards across a hop (Linux only,
+ *      elsewhere it is not checked)
+ *
+ *    A source qualifies if it is steady, never went backwards and has at
+ *    most kMaxResolutionNs resolution. The cheapest one that qualifies is
+ *    selected, steady_clock if none does. The TSC is only a candidate on an
+ *    invariant TSC (see TscClock).
+ *
+ *    AutoClock reads the selected source through a function pointer. It
+ *    reads steady_clock until AutoClock::Initialize() runs the probe, which
+ *    takes ~20 ms including the TSC calibration, so now() never allocates,
+ *    starts threads or throws. Call Initialize() at startup, before any
+ *    time points are taken: they are only comparable to each other while
+ *    the source stays the same, as the epoch depends on the source.
+ *    AutoClock only ever reads a steady source, Use() rejects the others.
+ *
+ * Example usage:
+ *    AutoClock::Initialize(); // at startup
+ *    LOG(INFO) << AutoClock::Report();
+ *
+ *    AutoStopWatch sw;  // i.e. ChronoMeter<AutoClock>
+ *    sw.ElapsedNs();
+ */
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "StopWatch.h"
+
+struct ClockCharacteristics {
+   std::string name;
+   bool available;
+   bool steady;
+   double readCostNs;
+   long long resolutionNs; // 0 if the clock never moved
+   uint64_t backwardSteps; // within one thread
+   bool crossCoreChecked; // false with only one CPU to run on
+   uint64_t crossCoreBackwardSteps;
+   long long crossCoreMaxSkewNs; // the largest backward step across a hop
+
+   std::string AsString() const;
+};
+
+class ClockProbe {
+public:
+   enum Source { kSteady, kHighResolution, kTsc, kSourceCount };
+
+   static const size_t kDefaultReads = 20000;
+   static const long long kMaxResolutionNs = 1000;
+
+   static const char* Name(Source source);
+
+   // Reads the source in ns since its epoch
+   static int64_t Read(Source source);
+
+   static ClockCharacteristics Probe(Source source, size_t reads = kDefaultReads);
+
+   // Indexed by Source
+   static std::vector<ClockCharacteristics> ProbeAll(size_t reads = kDefaultReads);
+
+   // The cheapest qualifying source, see the file description
+   static Source Select(const std::vector<ClockCharacteristics>& probed);
+};
+
+class AutoClock {
+public:
+   typedef std::chrono::nanoseconds duration;
+   typedef duration::rep rep;
+   typedef duration::period period;
+   typedef std::chrono::time_point<AutoClock> time_point;
+   static const bool is_steady = true; // every source it can read is steady
+
+   // steady_clock until Initialize() or Use()
+   static time_point now() noexcept {
+      return time_point(duration(mRead.load(std::memory_order_relaxed)()));
+   }
+
+   // Probes and selects the source, once. Call it before any time points
+   // are taken, a switch changes the epoch
+   static void Initialize();
+
+   /**
+    * Overrides the selection, e.g. from configuration. Call it before any
+    * time points are taken, a switch changes the epoch
+    * @return false, and the source is left alone, if source is not
+    *         available here or not steady, e.g. high_resolution_clock when
+    *         it is system_clock
+    */
+   static bool Use(ClockProbe::Source source);
+
+   static ClockProbe::Source Source();
+
+   // The selected source and what the probe measured, if it ran
+   static std::string Report();
+
+private:
+   typedef int64_t (*ReadFunction)();
+
+   static std::atomic<ReadFunction> mRead;
+};
+
+using AutoStopWatch = ChronoMeter<AutoClock>;
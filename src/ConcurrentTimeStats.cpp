@@ -0,0 +1,64 @@
+#include "ConcurrentTimeStats.h"
+#include <limits>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace {
+   void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+      _mm_pause();
+#else
+      std::this_thread::yield();
+#endif
+   }
+}
+
+ConcurrentTimeStats::ConcurrentTimeStats()
+   : mSequence(0)
+   , mMinTime(std::numeric_limits<long long>::max())
+   , mMaxTime(0)
+   , mCount(0)
+   , mTotalTime(0) {}
+
+ConcurrentTimeStats::StatsSnapshot ConcurrentTimeStats::Snapshot() const {
+   StatsSnapshot snapshot;
+   uint64_t before = 0;
+   uint64_t after = 0;
+   do {
+      before = mSequence.load(std::memory_order_acquire);
+      if (before & 1) {
+         CpuRelax();
+         continue;
+      }
+      snapshot.minTime = mMinTime.load(std::memory_order_relaxed);
+      snapshot.maxTime = mMaxTime.load(std::memory_order_relaxed);
+      snapshot.count = mCount.load(std::memory_order_relaxed);
+      snapshot.totalTime = mTotalTime.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = mSequence.load(std::memory_order_relaxed);
+   } while ((before & 1) || before != after);
+
+   snapshot.taken = clock::now();
+   snapshot.interval = clock::duration::zero();
+   return snapshot;
+}
+
+double ConcurrentTimeStats::StatsSnapshot::RatePerSecond() const {
+   const double seconds = std::chrono::duration<double>(interval).count();
+   return seconds > 0 ? count / seconds : 0;
+}
+
+ConcurrentTimeStats::StatsSnapshot ConcurrentTimeStats::StatsSnapshot::Delta(const StatsSnapshot& earlier) const {
+   StatsSnapshot delta = *this;
+   delta.count = count - earlier.count;
+   delta.totalTime = totalTime - earlier.totalTime;
+   delta.interval = taken - earlier.taken;
+   return delta;
+}
+
+TimeStats::Metrics ConcurrentTimeStats::StatsSnapshot::AsMetrics() const {
+   return std::make_tuple(minTime, maxTime, count, totalTime, Average());
+}
@@ -0,0 +1,94 @@
+/*
+ * File:   ConcurrentTimeStats.h
+ * Description: TimeStats for one writer thread and any number of reader
+ *    threads, e.g. a worker that calls Save and a monitoring thread that
+ *    reads the stats while the worker keeps going.
+ *
+ *    The state is protected by a seqlock. Save only does plain (relaxed)
+ *    stores and never a read-modify-write atomic. Snapshot() retries until
+ *    it has read the state without a Save in between, so a snapshot is never
+ *    torn. Nothing is reset by reading; the stats accumulate from creation
+ *    and interval numbers are computed as the Delta of two snapshots.
+ *
+ * Example usage:
+ *    ConcurrentTimeStats stats;          // shared
+ *    stats.Save(ns);                     // worker thread only
+ *
+ *    auto now = stats.Snapshot();        // monitoring thread
+ *    auto interval = now.Delta(previous);
+ *    LOG(INFO) << interval.RatePerSecond() << " calls/s, average " << interval.Average() << " ns";
+ *    previous = now;
+ */
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "AlignedNew.h"
+#include "TimeStats.h"
+
+// AlignedNew keeps the alignas(64) state on its own cache line also when
+// the stats are allocated with new
+class ConcurrentTimeStats : public AlignedNew<64> {
+public:
+   typedef std::chrono::steady_clock clock;
+
+   struct StatsSnapshot {
+      long long minTime;
+      long long maxTime;
+      long long count;
+      long long totalTime;
+      clock::time_point taken;
+      clock::duration interval; // zero unless made by Delta
+
+      long long Average() const { return count == 0 ? 0 : totalTime / count; }
+
+      // Saves per second over the interval, 0 unless made by Delta
+      double RatePerSecond() const;
+
+      /**
+       * The count and total time between an earlier snapshot and this one.
+       * Min and max can not be split in intervals, they are those of this
+       * snapshot.
+       */
+      StatsSnapshot Delta(const StatsSnapshot& earlier) const;
+
+      // Same layout as TimeStats::FlushAsMetrics
+      TimeStats::Metrics AsMetrics() const;
+   };
+
+   ConcurrentTimeStats();
+
+   ConcurrentTimeStats & operator=(const ConcurrentTimeStats&) = delete;
+   ConcurrentTimeStats(const ConcurrentTimeStats&) = delete;
+
+   // Only ever call from the one writer thread
+   void Save(long long ns) {
+      const uint64_t sequence = mSequence.load(std::memory_order_relaxed);
+      mSequence.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      mCount.store(mCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      mTotalTime.store(mTotalTime.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+      if (ns > mMaxTime.load(std::memory_order_relaxed)) {
+         mMaxTime.store(ns, std::memory_order_relaxed);
+      }
+      if (ns < mMinTime.load(std::memory_order_relaxed)) {
+         mMinTime.store(ns, std::memory_order_relaxed);
+      }
+
+      mSequence.store(sequence + 2, std::memory_order_release);
+   }
+
+   // Safe from any thread, does not reset anything
+   StatsSnapshot Snapshot() const;
+
+private:
+   // an odd sequence means a Save is in progress. The state gets a cache
+   // line of its own so that neighbouring data does not false share with it
+   alignas(64) std::atomic<uint64_t> mSequence;
+   std::atomic<long long> mMinTime;
+   std::atomic<long long> mMaxTime;
+   std::atomic<long long> mCount;
+   std::atomic<long long> mTotalTime;
+};
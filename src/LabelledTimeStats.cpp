@@ -0,0 +1,228 @@
+#include "LabelledTimeStats.h"
+#include <algorithm>
+#include <cstring>
+
+const char* const LabelledTimeStats::kOtherLabel = "other";
+const size_t LabelledTimeStats::kDefaultStripes;
+
+LabelledTimeStats::LabelledTimeStats(size_t maxLabels, size_t stripes)
+   : mMaxLabels(std::max<size_t>(1, maxLabels))
+   , mStripeCount(std::max<size_t>(1, stripes))
+   , mStripes(new Stripe[mStripeCount])
+   , mLabels(0) {
+   for (size_t i = 0; i < mStripeCount; ++i) {
+      mStripes[i].evictions = 0;
+   }
+}
+
+uint64_t LabelledTimeStats::Hash(const char* data, size_t size) {
+   uint64_t hash = 14695981039346656037ull;
+   for (size_t i = 0; i < size; ++i) {
+      hash ^= static_cast<uint8_t>(data[i]);
+      hash *= 1099511628211ull;
+   }
+   return hash;
+}
+
+void LabelledTimeStats::Save(const Label& label, long long ns) {
+   Save(label.hash, label.name.data(), label.name.size(), ns);
+}
+
+void LabelledTimeStats::Save(const std::string& label, long long ns) {
+   Save(Hash(label.data(), label.size()), label.data(), label.size(), ns);
+}
+
+void LabelledTimeStats::Save(uint64_t hash, const char* label, size_t size, long long ns) {
+   Stripe& stripe = StripeOf(hash);
+   std::lock_guard<std::mutex> lock(stripe.mutex);
+   Entry* entry = Find(stripe, hash, label, size);
+   if (entry == nullptr) {
+      stripe.other.Save(ns);
+      return;
+   }
+   ++entry->weight;
+   SiftDown(stripe, entry->heapIndex);
+   entry->stats.Save(ns);
+}
+
+LabelledTimeStats::Entry* LabelledTimeStats::Find(Stripe& stripe, uint64_t hash, const char* label, size_t size) {
+   auto range = stripe.entries.equal_range(hash);
+   for (auto it = range.first; it != range.second; ++it) {
+      const std::string& name = it->second.name;
+      if (name.size() == size && std::memcmp(name.data(), label, size) == 0) {
+         return &it->second;
+      }
+   }
+   return Insert(stripe, hash, label, size);
+}
+
+bool LabelledTimeStats::ReserveLabel() {
+   size_t labels = mLabels.load(std::memory_order_relaxed);
+   while (labels < mMaxLabels) {
+      if (mLabels.compare_exchange_weak(labels, labels + 1, std::memory_order_relaxed)) {
+         return true;
+      }
+   }
+   return false;
+}
+
+LabelledTimeStats::Entry* LabelledTimeStats::Insert(Stripe& stripe, uint64_t hash, const char* label, size_t size) {
+   uint64_t inherited = 0;
+   if (!ReserveLabel()) {
+      if (!stripe.lightest.empty()) {
+         inherited = EvictLightest(stripe);
+      } else if (!EvictFromOtherStripe(stripe, inherited)) {
+         return nullptr;
+      }
+   }
+   auto it = stripe.entries.emplace(std::piecewise_construct, std::forward_as_tuple(hash),
+                                    std::forward_as_tuple(hash, label, size, inherited));
+   Entry* entry = &it->second;
+   entry->heapIndex = stripe.lightest.size();
+   stripe.lightest.push_back(entry);
+   SiftUp(stripe, entry->heapIndex);
+   return entry;
+}
+
+// space-saving: the lightest label makes room, its measurements go to
+// "other" and the caller's new label takes over its weight
+uint64_t LabelledTimeStats::EvictLightest(Stripe& stripe) {
+   Entry* evicted = stripe.lightest.front();
+   const uint64_t weight = evicted->weight;
+   stripe.other.Merge(evicted->stats);
+   stripe.lightest.front() = stripe.lightest.back();
+   stripe.lightest.front()->heapIndex = 0;
+   stripe.lightest.pop_back();
+   SiftDown(stripe, 0);
+   auto range = stripe.entries.equal_range(evicted->hash);
+   for (auto it = range.first; it != range.second; ++it) {
+      if (&it->second == evicted) {
+         stripe.entries.erase(it);
+         break;
+      }
+   }
+   ++stripe.evictions;
+   return weight;
+}
+
+// Called with stripe's lock held when the label budget is used up and
+// stripe has no label to evict. The other stripes are only try-locked, so
+// two stripes doing this at once can not deadlock. Picks the stripe with
+// the lightest label among those that were not busy.
+bool LabelledTimeStats::EvictFromOtherStripe(Stripe& stripe, uint64_t& inherited) {
+   const size_t self = static_cast<size_t>(&stripe - mStripes.get());
+   size_t best = mStripeCount;
+   uint64_t bestWeight = 0;
+   for (size_t i = 1; i < mStripeCount; ++i) {
+      const size_t index = (self + i) % mStripeCount;
+      std::unique_lock<std::mutex> lock(mStripes[index].mutex, std::try_to_lock);
+      if (lock && !mStripes[index].lightest.empty()
+          && (best == mStripeCount || mStripes[index].lightest.front()->weight < bestWeight)) {
+         best = index;
+         bestWeight = mStripes[index].lightest.front()->weight;
+      }
+   }
+   if (best == mStripeCount) {
+      return false;
+   }
+   Stripe& victim = mStripes[best];
+   std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+   if (!lock || victim.lightest.empty()) {
+      return false;
+   }
+   inherited = EvictLightest(victim);
+   return true;
+}
+
+void LabelledTimeStats::SiftUp(Stripe& stripe, size_t index) {
+   std::vector<Entry*>& heap = stripe.lightest;
+   while (index > 0) {
+      const size_t parent = (index - 1) / 2;
+      if (heap[parent]->weight <= heap[index]->weight) {
+         return;
+      }
+      std::swap(heap[parent], heap[index]);
+      heap[parent]->heapIndex = parent;
+      heap[index]->heapIndex = index;
+      index = parent;
+   }
+}
+
+void LabelledTimeStats::SiftDown(Stripe& stripe, size_t index) {
+   std::vector<Entry*>& heap = stripe.lightest;
+   for (;;) {
+      size_t lightest = index;
+      const size_t left = 2 * index + 1;
+      const size_t right = left + 1;
+      if (left < heap.size() && heap[left]->weight < heap[lightest]->weight) {
+         lightest = left;
+      }
+      if (right < heap.size() && heap[right]->weight < heap[lightest]->weight) {
+         lightest = right;
+      }
+      if (lightest == index) {
+         return;
+      }
+      std::swap(heap[lightest], heap[index]);
+      heap[lightest]->heapIndex = lightest;
+      heap[index]->heapIndex = index;
+      index = lightest;
+   }
+}
+
+std::vector<LabelledTimeStats::LabelMetrics> LabelledTimeStats::FlushAsMetrics() {
+   std::vector<LabelMetrics> rows;
+   TimeStats other;
+   for (size_t i = 0; i < mStripeCount; ++i) {
+      Stripe& stripe = mStripes[i];
+      std::lock_guard<std::mutex> lock(stripe.mutex);
+      for (auto& pair : stripe.entries) {
+         Entry& entry = pair.second;
+         if (entry.stats.HasMetrics()) {
+            rows.push_back(LabelMetrics{entry.name, entry.stats.FlushAsMetrics(), entry.weight, entry.error});
+         }
+      }
+      if (stripe.other.HasMetrics()) {
+         other.Merge(stripe.other);
+         stripe.other.FlushAsMetrics();
+      }
+   }
+   std::sort(rows.begin(), rows.end(), [](const LabelMetrics& a, const LabelMetrics& b) {
+      return a.label < b.label;
+   });
+   if (other.HasMetrics()) {
+      const TimeStats::Metrics metrics = other.FlushAsMetrics();
+      const uint64_t count = static_cast<uint64_t>(std::get<TimeStats::Index::Count>(metrics));
+      rows.push_back(LabelMetrics{kOtherLabel, metrics, count, 0});
+   }
+   return rows;
+}
+
+std::string LabelledTimeStats::FlushAsString() {
+   const std::vector<LabelMetrics> rows = FlushAsMetrics();
+   if (rows.empty()) {
+      return std::string{"Count: 0, no measurements available"};
+   }
+   std::string str;
+   for (const auto& row : rows) {
+      str += (str.empty() ? "" : "\n") + row.label
+             + ": Count: " + std::to_string(std::get<TimeStats::Index::Count>(row.metrics))
+             + ", Min time: " + std::to_string(std::get<TimeStats::Index::MinTime>(row.metrics)) + " ns"
+             + ", Max time: " + std::to_string(std::get<TimeStats::Index::MaxTime>(row.metrics)) + " ns"
+             + ", Average: " + std::to_string(std::get<TimeStats::Index::Average>(row.metrics)) + " ns";
+   }
+   return str;
+}
+
+size_t LabelledTimeStats::Size() {
+   return mLabels.load(std::memory_order_relaxed);
+}
+
+uint64_t LabelledTimeStats::Evictions() {
+   uint64_t evictions = 0;
+   for (size_t i = 0; i < mStripeCount; ++i) {
+      std::lock_guard<std::mutex> lock(mStripes[i].mutex);
+      evictions += mStripes[i].evictions;
+   }
+   return evictions;
+}
@@ -0,0 +1,139 @@
+/*
+ * File:   LabelledTimeStats.h
+ * Description: A family of TimeStats keyed by a dynamic label, e.g. per log
+ *    source type or per parser, with a hard cap on the number of labels.
+ *
+ *    The labels are spread over striped shards, each a hash table behind
+ *    its own mutex, so threads saving to different labels rarely share a
+ *    lock. A Label carries its precomputed 64 bit hash. A lookup with a
+ *    Label, or with a string that is hashed in place, does not allocate
+ *    unless the label is new.
+ *
+ *    At most maxLabels labels exist at once. Once the cap is reached a new
+ *    label evicts the label with the lowest weight in its shard (the
+ *    space-saving heavy hitter algorithm, per shard so that eviction
+ *    usually only takes the shard's lock): the evicted label's
+ *    measurements move into the "other" row, and the new label takes over
+ *    the weight + 1, so the frequent labels stay and the long tail ends up
+ *    in "other". A new label whose shard is empty evicts the lightest label
+ *    of the other shards instead; only when all of them are busy at that
+ *    moment does that one measurement go to "other", the next one tries
+ *    again. Each shard keeps its labels in a min-heap on weight, so a save
+ *    costs O(log labels in the shard) under the lock. The weight counts
+ *    measurements over the lifetime of the label and is not reset by a
+ *    flush. The error is the weight a label inherited, an upper bound on
+ *    how much its weight overstates its own measurements.
+ *
+ * Example usage:
+ *    LabelledTimeStats parseTime(1000); // at most 1000 labels
+ *    static const LabelledTimeStats::Label kSyslog("syslog");
+ *
+ *    parseTime.Save(kSyslog, ns);           // precomputed hash
+ *    parseTime.Save(event.sourceType, ns);  // hashed in place
+ *
+ *    for (const auto& row : parseTime.FlushAsMetrics()) {
+ *       Publish(row.label, row.metrics);
+ *    }
+ */
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "TimeStats.h"
+
+class LabelledTimeStats {
+public:
+   static const char* const kOtherLabel;
+   static const size_t kDefaultStripes = 16;
+
+   // A label with its hash computed once
+   struct Label {
+      explicit Label(const std::string& label) : name(label), hash(Hash(label.data(), label.size())) {}
+
+      std::string name;
+      uint64_t hash;
+   };
+
+   struct LabelMetrics {
+      std::string label;
+      TimeStats::Metrics metrics; // since the last flush
+      uint64_t weight;
+      uint64_t error;
+   };
+
+   /**
+    * @param maxLabels hard cap on the number of labels, not counting "other"
+    * @param stripes shards with their own lock
+    */
+   explicit LabelledTimeStats(size_t maxLabels, size_t stripes = kDefaultStripes);
+
+   LabelledTimeStats & operator=(const LabelledTimeStats&) = delete;
+   LabelledTimeStats(const LabelledTimeStats&) = delete;
+
+   // 64 bit FNV-1a, the hash Label uses
+   static uint64_t Hash(const char* data, size_t size);
+
+   void Save(const Label& label, long long ns);
+   void Save(const std::string& label, long long ns);
+   // hash must be Hash(label, size), or the label is kept apart from the
+   // same label saved by name
+   void Save(uint64_t hash, const char* label, size_t size, long long ns);
+
+   /**
+    * One row per label with measurements since the last flush, and an
+    * "other" row if anything was evicted into it. Resets the measurements,
+    * the labels and their weights are kept.
+    */
+   std::vector<LabelMetrics> FlushAsMetrics();
+   std::string FlushAsString();
+
+   size_t Size();
+   size_t MaxLabels() const { return mMaxLabels; }
+   uint64_t Evictions();
+
+private:
+   struct Entry {
+      Entry(uint64_t labelHash, const char* label, size_t size, uint64_t inheritedWeight)
+         : hash(labelHash), name(label, size), weight(inheritedWeight), error(inheritedWeight), heapIndex(0) {}
+
+      uint64_t hash;
+      std::string name;
+      uint64_t weight;
+      uint64_t error;
+      size_t heapIndex; // position in Stripe::lightest
+      TimeStats stats;
+   };
+
+   struct IdentityHash {
+      size_t operator()(uint64_t hash) const { return static_cast<size_t>(hash); }
+   };
+
+   struct Stripe {
+      std::mutex mutex;
+      uint64_t evictions;
+      std::unordered_multimap<uint64_t, Entry, IdentityHash> entries;
+      std::vector<Entry*> lightest; // min-heap on weight
+      TimeStats other;
+   };
+
+   Stripe& StripeOf(uint64_t hash) { return mStripes[(hash >> 32) % mStripeCount]; }
+   // null if the label was not admitted and its measurement goes to "other"
+   Entry* Find(Stripe& stripe, uint64_t hash, const char* label, size_t size);
+   Entry* Insert(Stripe& stripe, uint64_t hash, const char* label, size_t size);
+   bool ReserveLabel();
+   uint64_t EvictLightest(Stripe& stripe);
+   bool EvictFromOtherStripe(Stripe& stripe, uint64_t& inherited);
+   static void SiftUp(Stripe& stripe, size_t index);
+   static void SiftDown(Stripe& stripe, size_t index);
+
+   const size_t mMaxLabels;
+   const size_t mStripeCount;
+   std::unique_ptr<Stripe[]> mStripes;
+   std::atomic<size_t> mLabels;
+};
@@ -0,0 +1,85 @@
+#include "LatencyHistogram.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+const size_t LatencyHistogram::kLinearBuckets;
+const size_t LatencyHistogram::kSubBucketBits;
+const size_t LatencyHistogram::kSubBuckets;
+const size_t LatencyHistogram::kBucketCount;
+
+LatencyHistogram::LatencyHistogram() : mTotal(0) {}
+
+size_t LatencyHistogram::BucketIndex(long long ns) {
+   if (ns < static_cast<long long>(kLinearBuckets)) {
+      return ns < 0 ? 0 : static_cast<size_t>(ns);
+   }
+   const uint64_t value = static_cast<uint64_t>(ns);
+   const size_t exponent = 63 - __builtin_clzll(value); // >= 6
+   const size_t shift = exponent - kSubBucketBits;
+   const size_t mantissa = static_cast<size_t>(value >> shift) - kSubBuckets; // [0, 32)
+   return kLinearBuckets + (exponent - 6) * kSubBuckets + mantissa;
+}
+
+long long LatencyHistogram::BucketLowerBound(size_t index) {
+   if (index < kLinearBuckets) {
+      return static_cast<long long>(index);
+   }
+   const size_t exponent = (index - kLinearBuckets) / kSubBuckets + 6;
+   const size_t mantissa = (index - kLinearBuckets) % kSubBuckets + kSubBuckets;
+   return static_cast<long long>(static_cast<uint64_t>(mantissa) << (exponent - kSubBucketBits));
+}
+
+long long LatencyHistogram::BucketUpperBound(size_t index) {
+   if (index + 1 >= kBucketCount) {
+      return std::numeric_limits<long long>::max();
+   }
+   return BucketLowerBound(index + 1) - 1;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+   if (other.mTotal == 0) {
+      return;
+   }
+   if (mCounts.empty()) {
+      mCounts.resize(kBucketCount, 0);
+   }
+   for (size_t i = 0; i < kBucketCount; ++i) {
+      mCounts[i] += other.mCounts[i];
+   }
+   mTotal += other.mTotal;
+}
+
+void LatencyHistogram::AddToBucket(size_t index, uint64_t count) {
+   if (index >= kBucketCount || count == 0) {
+      return;
+   }
+   if (mCounts.empty()) {
+      mCounts.resize(kBucketCount, 0);
+   }
+   mCounts[index] += count;
+   mTotal += count;
+}
+
+void LatencyHistogram::Reset() {
+   std::fill(mCounts.begin(), mCounts.end(), 0);
+   mTotal = 0;
+}
+
+long long LatencyHistogram::Percentile(double percentile) const {
+   if (mTotal == 0) {
+      return 0;
+   }
+   percentile = std::min(100.0, std::max(0.0, percentile));
+   uint64_t rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * mTotal));
+   rank = std::max<uint64_t>(rank, 1);
+
+   uint64_t seen = 0;
+   for (size_t i = 0; i < kBucketCount; ++i) {
+      seen += mCounts[i];
+      if (seen >= rank) {
+         return BucketUpperBound(i);
+      }
+   }
+   return BucketUpperBound(kBucketCount - 1);
+}
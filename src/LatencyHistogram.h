@@ -0,0 +1,57 @@
+/*
+ * File:   LatencyHistogram.h
+ * Description: A log-linear histogram of nanosecond values for percentiles.
+ *    Values below 64 get one bucket each. Above that every power of two is
+ *    split into 32 equally wide buckets, so a value is reported with at
+ *    most ~3% relative error. All of int64 fits in 1888 buckets.
+ *
+ *    The buckets are allocated on the first Record, an unused histogram
+ *    costs an empty vector. Histograms with the same layout merge losslessly.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class LatencyHistogram {
+public:
+   static const size_t kLinearBuckets = 64;
+   static const size_t kSubBucketBits = 5;
+   static const size_t kSubBuckets = 1 << kSubBucketBits;
+   static const size_t kBucketCount = kLinearBuckets + (63 - 6) * kSubBuckets;
+
+   LatencyHistogram();
+
+   // negative values are recorded as 0
+   void Record(long long ns) {
+      if (mCounts.empty()) {
+         mCounts.resize(kBucketCount, 0);
+      }
+      ++mCounts[BucketIndex(ns)];
+      ++mTotal;
+   }
+
+   void Merge(const LatencyHistogram& other);
+   void Reset();
+
+   uint64_t Count() const { return mTotal; }
+
+   /**
+    * @param percentile in the range [0, 100], e.g. 99.9
+    * @return the highest value that falls in the same bucket as the
+    *         percentile, 0 if nothing is recorded
+    */
+   long long Percentile(double percentile) const;
+
+   // Raw bucket access, e.g. for serialization
+   static size_t BucketIndex(long long ns);
+   static long long BucketLowerBound(size_t index);
+   static long long BucketUpperBound(size_t index);
+   uint64_t CountAt(size_t index) const { return mCounts.empty() ? 0 : mCounts[index]; }
+   void AddToBucket(size_t index, uint64_t count);
+
+private:
+   std::vector<uint64_t> mCounts;
+   uint64_t mTotal;
+};
@@ -0,0 +1,171 @@
+/*
+ * File:   LoadGenerator.h
+ * Description: An open loop load generator. Measuring a call in a closed
+ *    loop (issue, wait, issue ...) hides stalls: while a call stalls no new
+ *    calls are issued, so only one slow sample is recorded ("coordinated
+ *    omission").
+ *
+ *    The LoadGenerator instead issues calls at a fixed target rate from a
+ *    precomputed schedule. The i:th call is intended to start at
+ *    i / rate after the start of the run. Its latency is measured from that
+ *    intended start, not from when it actually got issued, so time spent
+ *    waiting behind a stalled call is counted. The latency from the actual
+ *    start (the service time) is kept as well.
+ *
+ *    Calls are spread over a number of issuer threads. Call k is issued by
+ *    thread k % issuers. The callable must be safe to call from all of them.
+ *
+ *    The Clock template parameter is the ChronoMeter clock used for all
+ *    measurements, e.g. std::chrono::high_resolution_clock or TscClock.
+ *
+ * Example usage:
+ *    LoadGenerator<TscClock>::Config config;
+ *    config.ratePerSecond = 20000;
+ *    config.duration = std::chrono::seconds(10);
+ *    config.issuers = 4;
+ *    auto result = LoadGenerator<TscClock>::Run(config, [&] { client.Send(event); });
+ *    std::cout << result.FlushAsString() << std::endl;
+ */
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "StopWatch.h"
+#include "TimeStats.h"
+
+template<typename Clock = std::chrono::high_resolution_clock> class LoadGenerator {
+public:
+   struct Config {
+      Config() : ratePerSecond(1000), duration(std::chrono::seconds(1)), issuers(1) {}
+
+      double ratePerSecond;
+      std::chrono::nanoseconds duration;
+      size_t issuers;
+   };
+
+   struct Result {
+      double targetRate;
+      double achievedRate;
+      long long issued;
+      TimeStats latency; // from the intended start, histogram enabled
+      TimeStats service; // from the actual start, histogram enabled
+
+      std::string FlushAsString() {
+         return "Target rate: " + std::to_string(static_cast<long long>(targetRate)) + "/s"
+                + ", Achieved rate: " + std::to_string(static_cast<long long>(achievedRate)) + "/s"
+                + ", Issued: " + std::to_string(issued)
+                + "\n\tLatency (from intended start): " + latency.FlushAsString()
+                + "\n\tService time: " + service.FlushAsString();
+      }
+   };
+
+   struct SweepConfig {
+      SweepConfig() : startRate(1000), maxRate(1000000), rateFactor(1.25), sloPercentile(99),
+         sloNs(1000000), stepDuration(std::chrono::seconds(1)), issuers(1) {}
+
+      double startRate;
+      double maxRate;
+      double rateFactor; // the rate is multiplied with this every step
+      double sloPercentile;
+      long long sloNs; // the step fails when sloPercentile of the latency is above this
+      std::chrono::nanoseconds stepDuration;
+      size_t issuers;
+   };
+
+   struct SweepStep {
+      double rate;
+      long long percentileNs;
+      bool withinSlo;
+   };
+
+   struct SweepResult {
+      double maxRateWithinSlo; // 0 if not even the start rate was within the SLO
+      std::vector<SweepStep> steps;
+   };
+
+   template<typename Callable> static Result Run(const Config& config, Callable call) {
+      const size_t issuers = std::max<size_t>(1, config.issuers);
+      const double intervalNs = 1e9 / config.ratePerSecond;
+      const long long total = static_cast<long long>(config.duration.count() / intervalNs);
+
+      std::vector<TimeStats> latency(issuers);
+      std::vector<TimeStats> service(issuers);
+      ChronoMeter<Clock> start;
+      std::vector<std::thread> threads;
+      for (size_t issuer = 0; issuer < issuers; ++issuer) {
+         latency[issuer].EnableHistogram();
+         service[issuer].EnableHistogram();
+         threads.emplace_back([&, issuer] {
+            for (long long k = issuer; k < total; k += issuers) {
+               const long long intended = static_cast<long long>(k * intervalNs);
+               WaitUntil(start, intended);
+               const long long issued = static_cast<long long>(start.ElapsedNs());
+               call();
+               const long long done = static_cast<long long>(start.ElapsedNs());
+               latency[issuer].Save(done - intended, static_cast<uint64_t>(k));
+               service[issuer].Save(done - issued, static_cast<uint64_t>(k));
+            }
+         });
+      }
+      for (auto& thread : threads) {
+         thread.join();
+      }
+      const double elapsedNs = static_cast<double>(start.ElapsedNs());
+
+      Result result;
+      result.targetRate = config.ratePerSecond;
+      result.issued = total;
+      result.achievedRate = elapsedNs > 0 ? total * 1e9 / elapsedNs : 0;
+      result.latency.EnableHistogram();
+      result.service.EnableHistogram();
+      for (size_t issuer = 0; issuer < issuers; ++issuer) {
+         result.latency.Merge(latency[issuer]);
+         result.service.Merge(service[issuer]);
+      }
+      return result;
+   }
+
+   /**
+    * Runs steps of increasing rate until the latency percentile breaks the
+    * SLO or maxRate is reached
+    */
+   template<typename Callable> static SweepResult Sweep(const SweepConfig& config, Callable call) {
+      SweepResult sweep;
+      sweep.maxRateWithinSlo = 0;
+      Config step;
+      step.duration = config.stepDuration;
+      step.issuers = config.issuers;
+      for (double rate = config.startRate; rate <= config.maxRate; rate *= std::max(config.rateFactor, 1.01)) {
+         step.ratePerSecond = rate;
+         Result result = Run(step, call);
+         SweepStep outcome;
+         outcome.rate = rate;
+         outcome.percentileNs = result.latency.Percentile(config.sloPercentile);
+         outcome.withinSlo = (outcome.percentileNs <= config.sloNs);
+         sweep.steps.push_back(outcome);
+         if (!outcome.withinSlo) {
+            break;
+         }
+         sweep.maxRateWithinSlo = rate;
+      }
+      return sweep;
+   }
+
+private:
+   // Sleeps while the intended start is far away and yields the last stretch
+   static void WaitUntil(const ChronoMeter<Clock>& start, long long intendedNs) {
+      const long long kSpinNs = 50000;
+      long long left = intendedNs - static_cast<long long>(start.ElapsedNs());
+      while (left > 0) {
+         if (left > kSpinNs) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(left - kSpinNs));
+         } else {
+            std::this_thread::yield();
+         }
+         left = intendedNs - static_cast<long long>(start.ElapsedNs());
+      }
+   }
+};
@@ -0,0 +1,186 @@
+/*
+ * File:   PhaseTimer.h
+ * Description: Times the fixed phases of a pipeline event (decode, parse,
+ *    enrich ...) with one clock read per phase boundary, instead of one
+ *    TriggerTimeStats with two clock reads per phase.
+ *
+ *    The phases are a compile-time list of tag types that each have a
+ *    static Name(). Begin() reads the clock once, every Mark<Phase>() reads
+ *    it once and attributes the time since the previous boundary to that
+ *    phase. Finish() closes the event without another clock read and
+ *    records the end-to-end time, so each phase can be reported as its
+ *    share of the end-to-end time.
+ *
+ *    The per-phase stats are kept as structure of arrays, one contiguous
+ *    array each for count, total, min and max. Marking a phase touches one
+ *    element of each. Use one PhaseTimer per thread.
+ *
+ *    PhaseTimer uses steady_clock, BasicPhaseTimer<Clock, Phases...> takes
+ *    any clock, e.g. TscClock for cheaper reads or VirtualClock in tests.
+ *
+ * Example usage:
+ *    struct Decode { static const char* Name() { return "decode"; } };
+ *    struct Parse  { static const char* Name() { return "parse"; } };
+ *    struct Write  { static const char* Name() { return "write"; } };
+ *
+ *    PhaseTimer<Decode, Parse, Write> timer;
+ *    for (auto& event : events) {
+ *       timer.Begin();
+ *       Decode(event); timer.Mark<Decode>();
+ *       Parse(event);  timer.Mark<Parse>();
+ *       Write(event);  timer.Mark<Write>();
+ *       timer.Finish();
+ *    }
+ *    LOG(INFO) << timer.FlushAsString();
+ */
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include "TimeStats.h"
+
+namespace phase_detail {
+   template<typename Phase, typename... Phases> struct IndexOf;
+
+   template<typename Phase> struct IndexOf<Phase> {
+      static_assert(sizeof(Phase) == 0, "the phase is not in the PhaseTimer's phase list");
+   };
+
+   template<typename Phase, typename... Rest> struct IndexOf<Phase, Phase, Rest...>
+      : std::integral_constant<size_t, 0> {};
+
+   template<typename Phase, typename First, typename... Rest> struct IndexOf<Phase, First, Rest...>
+      : std::integral_constant<size_t, 1 + IndexOf<Phase, Rest...>::value> {};
+}
+
+template<typename Clock, typename... Phases> class BasicPhaseTimer {
+public:
+   static const size_t kPhases = sizeof...(Phases);
+   static_assert(kPhases > 0, "a PhaseTimer needs at least one phase");
+
+   BasicPhaseTimer() {
+      Reset();
+      mBegin = mLast = Clock::now();
+   }
+
+   // Starts an event, one clock read
+   void Begin() {
+      mBegin = mLast = Clock::now();
+   }
+
+   // Ends Phase of the current event, one clock read
+   template<typename Phase> void Mark() {
+      const typename Clock::time_point now = Clock::now();
+      Record(phase_detail::IndexOf<Phase, Phases...>::value, ToNs(now - mLast));
+      mLast = now;
+   }
+
+   // Ends the event at the last Mark, no clock read
+   void Finish() {
+      const long long ns = ToNs(mLast - mBegin);
+      ++mEndToEndCount;
+      mEndToEndTotal += ns;
+      mEndToEndMin = std::min(mEndToEndMin, ns);
+      mEndToEndMax = std::max(mEndToEndMax, ns);
+   }
+
+   static const char* Name(size_t phase) {
+      static const std::array<const char*, kPhases> names{{Phases::Name()...}};
+      return names[phase];
+   }
+
+   template<typename Phase> static constexpr size_t IndexOf() {
+      return phase_detail::IndexOf<Phase, Phases...>::value;
+   }
+
+   // In TimeStats::Metrics layout, since the last flush
+   TimeStats::Metrics PhaseMetrics(size_t phase) const {
+      return MakeMetrics(mMin[phase], mMax[phase], mCount[phase], mTotal[phase]);
+   }
+
+   TimeStats::Metrics EndToEndMetrics() const {
+      return MakeMetrics(mEndToEndMin, mEndToEndMax, mEndToEndCount, mEndToEndTotal);
+   }
+
+   // The phase's share of the end-to-end time, 0 - 1
+   double Share(size_t phase) const {
+      return mEndToEndTotal > 0 ? static_cast<double>(mTotal[phase]) / mEndToEndTotal : 0;
+   }
+
+   template<typename Phase> double Share() const {
+      return Share(IndexOf<Phase>());
+   }
+
+   std::string FlushAsString() {
+      if (mEndToEndCount == 0 && std::all_of(mCount.begin(), mCount.end(), [](long long count) { return count == 0; })) {
+         Reset();
+         return std::string{"Count: 0, no measurements available"};
+      }
+      std::string str = "End to end: Count: " + std::to_string(mEndToEndCount)
+                        + ", Average: " + std::to_string(Average(mEndToEndTotal, mEndToEndCount)) + " ns"
+                        + ", Max time: " + std::to_string(mEndToEndMax) + " ns";
+      for (size_t phase = 0; phase < kPhases; ++phase) {
+         str += "\n\t" + std::string(Name(phase)) + ": Count: " + std::to_string(mCount[phase])
+                + ", Average: " + std::to_string(Average(mTotal[phase], mCount[phase])) + " ns"
+                + ", Max time: " + std::to_string(mMax[phase]) + " ns"
+                + ", Share: " + Percent(Share(phase)) + " %";
+      }
+      Reset();
+      return str;
+   }
+
+   void Reset() {
+      mCount.fill(0);
+      mTotal.fill(0);
+      mMin.fill(std::numeric_limits<long long>::max());
+      mMax.fill(0);
+      mEndToEndCount = mEndToEndTotal = mEndToEndMax = 0;
+      mEndToEndMin = std::numeric_limits<long long>::max();
+   }
+
+private:
+   template<typename Duration> static long long ToNs(Duration d) {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+   }
+
+   static long long Average(long long total, long long count) {
+      return count == 0 ? 0 : total / count;
+   }
+
+   // one decimal, e.g. "12.5"
+   static std::string Percent(double share) {
+      const long long tenths = static_cast<long long>(share * 1000 + 0.5);
+      return std::to_string(tenths / 10) + "." + std::to_string(tenths % 10);
+   }
+
+   static TimeStats::Metrics MakeMetrics(long long min, long long max, long long count, long long total) {
+      return std::make_tuple(min, max, count, total, Average(total, count));
+   }
+
+   void Record(size_t phase, long long ns) {
+      ++mCount[phase];
+      mTotal[phase] += ns;
+      mMin[phase] = std::min(mMin[phase], ns);
+      mMax[phase] = std::max(mMax[phase], ns);
+   }
+
+   typename Clock::time_point mBegin;
+   typename Clock::time_point mLast;
+   std::array<long long, kPhases> mCount;
+   std::array<long long, kPhases> mTotal;
+   std::array<long long, kPhases> mMin;
+   std::array<long long, kPhases> mMax;
+   long long mEndToEndCount;
+   long long mEndToEndTotal;
+   long long mEndToEndMin;
+   long long mEndToEndMax;
+};
+
+template<typename Clock, typename... Phases> const size_t BasicPhaseTimer<Clock, Phases...>::kPhases;
+
+template<typename... Phases> using PhaseTimer = BasicPhaseTimer<std::chrono::steady_clock, Phases...>;
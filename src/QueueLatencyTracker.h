@@ -0,0 +1,229 @@
+/*
+ * File:   QueueLatencyTracker.h
+ * Description: Measures how long messages sit in a queue between a
+ *    producer thread and a consumer thread (the sojourn time).
+ *
+ *    The producer stamps a QueueStamp that travels inside the message, one
+ *    clock read and no shared write. The consumer closes the stamp, one
+ *    clock read, and the sojourn time goes into stats that any number of
+ *    consumer threads can update at once: fetch_add for count and total, a
+ *    compare-and-swap loop for min and max (which almost never loops once
+ *    the extremes have settled).
+ *
+ *    Depth sampling relates wait time to backlog. The producer passes the
+ *    queue depth it saw when enqueuing, or the tracker counts the depth
+ *    itself when constructed with trackDepth (costs an atomic increment and
+ *    decrement per message). Every depthSampleEvery:th closed stamp adds
+ *    its wait to the bucket of its depth, the buckets are powers of two:
+ *    0, 1, 2-3, 4-7 ...
+ *
+ *    TakeSnapshot() reads the atomics one by one. Numbers from messages
+ *    closed while it runs can be split over the fields, which is fine for
+ *    monitoring.
+ *
+ * Example usage:
+ *    struct Event { QueueStamp stamp; ... };
+ *    QueueLatencyTracker ingress(64); // sample depth every 64th message
+ *
+ *    // producer
+ *    ingress.Stamp(event.stamp, queue.size());
+ *    queue.push(event);
+ *
+ *    // consumer
+ *    queue.pop(event);
+ *    ingress.Close(event.stamp);
+ *
+ *    LOG(INFO) << "Ingress queue: " << ingress.TakeSnapshot().AsString();
+ */
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include "AlignedNew.h"
+#include "TimeStats.h"
+
+// Embedded in a message, set by the producer and closed by the consumer.
+// 16 bytes: the 4 byte depth is padded to the alignment of enqueuedNs.
+struct QueueStamp {
+   QueueStamp() : enqueuedNs(0), depth(kNoDepth) {}
+
+   static const uint32_t kNoDepth = UINT32_MAX;
+
+   int64_t enqueuedNs;
+   uint32_t depth; // queue depth when enqueued, kNoDepth if not known
+};
+
+static_assert(sizeof(QueueStamp) == 16, "QueueStamp grew, it is carried in every message");
+
+// Heap allocated through AlignedNew, C++14 new does not honor the alignas(64) members
+template<typename Clock = std::chrono::steady_clock> class BasicQueueLatencyTracker : public AlignedNew<64> {
+public:
+   static const size_t kDepthBuckets = 33;
+
+   struct DepthBucket {
+      uint64_t minDepth;
+      uint64_t maxDepth;
+      uint64_t samples;
+      uint64_t totalWaitNs;
+
+      long long AverageWaitNs() const { return samples == 0 ? 0 : static_cast<long long>(totalWaitNs / samples); }
+   };
+
+   struct Snapshot {
+      long long minTime;
+      long long maxTime;
+      long long count;
+      long long totalTime;
+      std::vector<DepthBucket> depth; // only the buckets that have samples
+
+      long long Average() const { return count == 0 ? 0 : totalTime / count; }
+
+      // Same layout as TimeStats::FlushAsMetrics
+      TimeStats::Metrics AsMetrics() const {
+         return std::make_tuple(minTime, maxTime, count, totalTime, Average());
+      }
+
+      std::string AsString() const {
+         std::string str = "Count: " + std::to_string(count)
+                           + ", Average wait: " + std::to_string(Average() / 1000) + " us"
+                           + ", Max wait: " + std::to_string(maxTime / 1000) + " us";
+         for (const auto& bucket : depth) {
+            str += ", Depth " + std::to_string(bucket.minDepth) + "-" + std::to_string(bucket.maxDepth)
+                   + ": " + std::to_string(bucket.AverageWaitNs() / 1000) + " us";
+         }
+         return str;
+      }
+   };
+
+   /**
+    * @param depthSampleEvery add every n:th closed stamp to the depth
+    *        buckets, 0 disables depth sampling
+    * @param trackDepth count the queue depth here instead of having the
+    *        producer pass it to Stamp
+    */
+   explicit BasicQueueLatencyTracker(size_t depthSampleEvery = 0, bool trackDepth = false)
+      : mDepthSampleEvery(depthSampleEvery)
+      , mTrackDepth(trackDepth)
+      , mCount(0)
+      , mTotalTime(0)
+      , mMinTime(std::numeric_limits<long long>::max())
+      , mMaxTime(0)
+      , mDepth(0) {
+      for (auto& bucket : mDepthBuckets) {
+         bucket.samples.store(0, std::memory_order_relaxed);
+         bucket.totalWaitNs.store(0, std::memory_order_relaxed);
+      }
+   }
+
+   BasicQueueLatencyTracker & operator=(const BasicQueueLatencyTracker&) = delete;
+   BasicQueueLatencyTracker(const BasicQueueLatencyTracker&) = delete;
+
+   // Producer side, right before the message is enqueued
+   void Stamp(QueueStamp& stamp) {
+      if (mTrackDepth) {
+         const uint64_t depth = mDepth.fetch_add(1, std::memory_order_relaxed);
+         stamp.depth = static_cast<uint32_t>(std::min<uint64_t>(depth, QueueStamp::kNoDepth - 1));
+      }
+      stamp.enqueuedNs = NowNs();
+   }
+
+   // Producer side, with the depth the producer saw
+   void Stamp(QueueStamp& stamp, size_t depth) {
+      stamp.depth = static_cast<uint32_t>(std::min<size_t>(depth, QueueStamp::kNoDepth - 1));
+      stamp.enqueuedNs = NowNs();
+   }
+
+   /**
+    * Consumer side, right after the message is dequeued
+    * @return the sojourn time in ns
+    */
+   long long Close(const QueueStamp& stamp) {
+      const long long ns = std::max<long long>(0, NowNs() - stamp.enqueuedNs);
+      if (mTrackDepth) {
+         mDepth.fetch_sub(1, std::memory_order_relaxed);
+      }
+      const long long sequence = mCount.fetch_add(1, std::memory_order_relaxed);
+      mTotalTime.fetch_add(ns, std::memory_order_relaxed);
+      UpdateMin(ns);
+      UpdateMax(ns);
+      if (mDepthSampleEvery != 0 && stamp.depth != QueueStamp::kNoDepth && sequence % mDepthSampleEvery == 0) {
+         DepthSlot& bucket = mDepthBuckets[DepthBucketIndex(stamp.depth)];
+         bucket.samples.fetch_add(1, std::memory_order_relaxed);
+         bucket.totalWaitNs.fetch_add(static_cast<uint64_t>(ns), std::memory_order_relaxed);
+      }
+      return ns;
+   }
+
+   // Messages stamped but not closed yet, 0 unless trackDepth
+   uint64_t Depth() const {
+      return mDepth.load(std::memory_order_relaxed);
+   }
+
+   Snapshot TakeSnapshot() const {
+      Snapshot snapshot;
+      snapshot.count = mCount.load(std::memory_order_relaxed);
+      snapshot.totalTime = mTotalTime.load(std::memory_order_relaxed);
+      snapshot.minTime = mMinTime.load(std::memory_order_relaxed);
+      snapshot.maxTime = mMaxTime.load(std::memory_order_relaxed);
+      for (size_t i = 0; i < kDepthBuckets; ++i) {
+         const uint64_t samples = mDepthBuckets[i].samples.load(std::memory_order_relaxed);
+         if (samples == 0) {
+            continue;
+         }
+         DepthBucket bucket;
+         bucket.minDepth = (i == 0) ? 0 : (1ull << (i - 1));
+         bucket.maxDepth = (i == 0) ? 0 : (1ull << i) - 1;
+         bucket.samples = samples;
+         bucket.totalWaitNs = mDepthBuckets[i].totalWaitNs.load(std::memory_order_relaxed);
+         snapshot.depth.push_back(bucket);
+      }
+      return snapshot;
+   }
+
+   static size_t DepthBucketIndex(uint64_t depth) {
+      return depth == 0 ? 0 : std::min<size_t>(kDepthBuckets - 1, 64 - __builtin_clzll(depth));
+   }
+
+private:
+   struct DepthSlot {
+      std::atomic<uint64_t> samples;
+      std::atomic<uint64_t> totalWaitNs;
+   };
+
+   static long long NowNs() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+   }
+
+   void UpdateMin(long long ns) {
+      long long current = mMinTime.load(std::memory_order_relaxed);
+      while (ns < current && !mMinTime.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+      }
+   }
+
+   void UpdateMax(long long ns) {
+      long long current = mMaxTime.load(std::memory_order_relaxed);
+      while (ns > current && !mMaxTime.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+      }
+   }
+
+   // read only, read by the producers on every Stamp
+   const size_t mDepthSampleEvery;
+   const bool mTrackDepth;
+   // written by the consumers, on a line of its own
+   alignas(64) std::atomic<long long> mCount;
+   std::atomic<long long> mTotalTime;
+   std::atomic<long long> mMinTime;
+   std::atomic<long long> mMaxTime;
+   // written by producers and consumers, kept off the line above
+   alignas(64) std::atomic<uint64_t> mDepth;
+   DepthSlot mDepthBuckets[kDepthBuckets]; // written by the consumers, every n:th message
+};
+
+template<typename Clock> const size_t BasicQueueLatencyTracker<Clock>::kDepthBuckets;
+
+using QueueLatencyTracker = BasicQueueLatencyTracker<>;
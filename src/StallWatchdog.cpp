@@ -0,0 +1,244 @@
+#include "StallWatchdog.h"
+#include <execinfo.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+   const int kMaxFrames = 64;
+   const int kHandlerFrames = 2; // CaptureHandler and the signal trampoline
+   const std::chrono::milliseconds kBacktraceTimeout(100);
+
+   // One capture at a time, the signal handler writes here
+   std::mutex gCaptureMutex;
+   uint64_t gLastRequest = 0; // under gCaptureMutex
+   void* gFrames[kMaxFrames];
+   std::atomic<int> gFrameCount(0);
+   std::atomic<uint64_t> gRequest(0); // the capture that waits for a stack, 0 if none
+   std::atomic<uint64_t> gCaptured(0); // the request whose stack is in gFrames
+   std::atomic<bool> gWriting(false); // a handler owns gFrames
+
+   void CaptureHandler(int, siginfo_t* info, void*) {
+      const int savedErrno = errno;
+#ifdef __linux__
+      const uint64_t request = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(info->si_value.sival_ptr));
+#else
+      (void)info;
+      const uint64_t request = gRequest.load(std::memory_order_acquire);
+#endif
+      // a handler that runs late, after its capture timed out, finds another
+      // request or none and leaves gFrames alone
+      bool idle = false;
+      if (gWriting.compare_exchange_strong(idle, true, std::memory_order_acquire)) {
+         if (request != 0 && request == gRequest.load(std::memory_order_acquire)) {
+            gFrameCount.store(backtrace(gFrames, kMaxFrames), std::memory_order_relaxed);
+            gCaptured.store(request, std::memory_order_release);
+         }
+         gWriting.store(false, std::memory_order_release);
+      }
+      errno = savedErrno;
+   }
+
+   void InstallCaptureHandler(int signal, struct sigaction* previous) {
+      // backtrace() loads libgcc on its first call, which allocates.
+      // Do that here and not in the signal handler.
+      void* warmUp[2];
+      backtrace(warmUp, 2);
+
+      struct sigaction action;
+      std::memset(&action, 0, sizeof(action));
+      action.sa_sigaction = CaptureHandler;
+      action.sa_flags = SA_RESTART | SA_SIGINFO;
+      sigemptyset(&action.sa_mask);
+      sigaction(signal, &action, previous);
+   }
+
+   int SendCaptureSignal(pthread_t thread, int signal, uint64_t request) {
+#ifdef __linux__
+      union sigval value;
+      value.sival_ptr = reinterpret_cast<void*>(static_cast<uintptr_t>(request));
+      return pthread_sigqueue(thread, signal, value);
+#else
+      (void)request; // the handler reads gRequest instead
+      return pthread_kill(thread, signal);
+#endif
+   }
+}
+
+StallWatchdog::Handle::Handle(Handle&& other)
+   : mWatchdog(other.mWatchdog)
+   , mSlot(other.mSlot) {
+   other.mWatchdog = nullptr;
+   other.mSlot = nullptr;
+}
+
+StallWatchdog::Handle::~Handle() {
+   if (mWatchdog != nullptr) {
+      mWatchdog->Unregister(mSlot);
+   }
+}
+
+StallWatchdog::StallWatchdog(std::chrono::milliseconds checkInterval, StallCallback callback,
+                             bool captureBacktrace, int backtraceSignal)
+   : mCallback(callback)
+   , mCheckInterval(checkInterval)
+   , mCaptureBacktrace(captureBacktrace)
+   , mBacktraceSignal(backtraceSignal)
+   , mStalls(0)
+   , mCaptureTimedOut(false)
+   , mStop(false) {
+   std::memset(&mPreviousAction, 0, sizeof(mPreviousAction));
+   if (mCaptureBacktrace) {
+      InstallCaptureHandler(mBacktraceSignal, &mPreviousAction);
+   }
+   mMonitor = std::thread(&StallWatchdog::MonitorThread, this);
+}
+
+StallWatchdog::~StallWatchdog() {
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStop = true;
+   }
+   mWakeUp.notify_one();
+   mMonitor.join();
+   // after a timed out capture the signal may still be pending, and the
+   // previous disposition could be to terminate the process
+   if (mCaptureBacktrace && !mCaptureTimedOut) {
+      sigaction(mBacktraceSignal, &mPreviousAction, nullptr);
+   }
+}
+
+StallWatchdog::Handle StallWatchdog::Register(std::chrono::milliseconds threshold, const std::string& name) {
+   std::lock_guard<std::mutex> lock(mMutex);
+   mSlots.emplace_back(new Slot);
+   Slot& slot = *mSlots.back();
+   slot.beats.store(0, std::memory_order_relaxed);
+   slot.thread = pthread_self();
+   slot.threadId = std::this_thread::get_id();
+   slot.name = name;
+   slot.threshold = threshold;
+   slot.lastBeats = 0;
+   slot.lastChange = clock::now();
+   slot.reported = false;
+   slot.capturing = false;
+   return Handle(this, &slot);
+}
+
+size_t StallWatchdog::RegisteredCount() {
+   std::lock_guard<std::mutex> lock(mMutex);
+   return mSlots.size();
+}
+
+void StallWatchdog::Unregister(Slot* slot) {
+   std::unique_lock<std::mutex> lock(mMutex);
+   for (auto it = mSlots.begin(); it != mSlots.end(); ++it) {
+      if (it->get() == slot) {
+         // the thread must stay alive while it is sent the capture signal
+         mCaptureDone.wait(lock, [slot] { return !slot->capturing; });
+         mSlots.erase(it);
+         return;
+      }
+   }
+}
+
+void StallWatchdog::MonitorThread() {
+   std::vector<StallReport> stalls;
+   std::vector<Slot*> captures;
+   std::unique_lock<std::mutex> lock(mMutex);
+   while (!mWakeUp.wait_for(lock, mCheckInterval, [this] { return mStop; })) {
+      Check(stalls, captures);
+      if (stalls.empty()) {
+         continue;
+      }
+      // backtraces are taken without the lock, the callback may register
+      // or unregister threads
+      lock.unlock();
+      if (!captures.empty()) {
+         for (size_t i = 0; i < captures.size(); ++i) {
+            stalls[i].backtrace = CaptureBacktrace(captures[i]->thread);
+         }
+         lock.lock();
+         for (Slot* slot : captures) {
+            slot->capturing = false;
+         }
+         captures.clear();
+         lock.unlock();
+         mCaptureDone.notify_all();
+      }
+      for (const auto& stall : stalls) {
+         mCallback(stall);
+      }
+      stalls.clear();
+      lock.lock();
+   }
+}
+
+// Called with mMutex held. A slot to capture is marked, so its thread can
+// not unregister and exit before the backtrace is taken. With
+// captureBacktrace every stall gets a capture, captures[i] is stalls[i]
+void StallWatchdog::Check(std::vector<StallReport>& stalls, std::vector<Slot*>& captures) {
+   const clock::time_point now = clock::now();
+   for (auto& pointer : mSlots) {
+      Slot& slot = *pointer;
+      const uint64_t beats = slot.beats.load(std::memory_order_relaxed);
+      if (beats != slot.lastBeats) {
+         slot.lastBeats = beats;
+         slot.lastChange = now;
+         slot.reported = false;
+         continue;
+      }
+      const clock::duration stalled = now - slot.lastChange;
+      if (slot.reported || stalled <= slot.threshold) {
+         continue;
+      }
+
+      slot.reported = true;
+      mStalls.fetch_add(1, std::memory_order_relaxed);
+      StallReport report;
+      report.threadId = slot.threadId;
+      report.name = slot.name;
+      report.stalled = std::chrono::duration_cast<std::chrono::nanoseconds>(stalled);
+      if (mCaptureBacktrace) {
+         slot.capturing = true;
+         captures.push_back(&slot);
+      }
+      stalls.push_back(std::move(report));
+   }
+}
+
+std::vector<std::string> StallWatchdog::CaptureBacktrace(pthread_t thread) {
+   std::vector<std::string> frames;
+   std::lock_guard<std::mutex> capture(gCaptureMutex);
+   const uint64_t request = ++gLastRequest;
+   gRequest.store(request, std::memory_order_release);
+   if (SendCaptureSignal(thread, mBacktraceSignal, request) != 0) {
+      gRequest.store(0, std::memory_order_release);
+      return frames;
+   }
+
+   const clock::time_point giveUp = clock::now() + kBacktraceTimeout;
+   while (gCaptured.load(std::memory_order_acquire) != request) {
+      if (clock::now() > giveUp) {
+         gRequest.store(0, std::memory_order_release);
+         mCaptureTimedOut = true;
+         return frames;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+   }
+   // no handler writes gFrames once the request is withdrawn
+   gRequest.store(0, std::memory_order_release);
+
+   const int count = gFrameCount.load(std::memory_order_relaxed);
+   const int skip = std::min(kHandlerFrames, count);
+   char** symbols = backtrace_symbols(gFrames + skip, count - skip);
+   if (symbols == nullptr) {
+      return frames;
+   }
+   for (int i = 0; i < count - skip; ++i) {
+      frames.push_back(symbols[i]);
+   }
+   std::free(symbols);
+   return frames;
+}
@@ -0,0 +1,140 @@
+/*
+ * File:   StallWatchdog.h
+ * Description: Detects threads that stopped making progress. A thread
+ *    registers itself and calls Heartbeat() on its handle whenever it gets
+ *    work done. Heartbeat() is a relaxed store of an incremented counter to
+ *    a cache line owned by that thread: no lock, no clock read and no
+ *    read-modify-write atomic.
+ *
+ *    One monitor thread looks at all counters every check interval. A
+ *    counter that has not changed for longer than the thread's threshold is
+ *    a stall and the callback is called once for it, with the thread id,
+ *    name and how long it has been stalled. When the thread heartbeats
+ *    again it is armed for the next stall.
+ *
+ *    With captureBacktrace the monitor sends the stalled thread a signal
+ *    (SIGUSR2 by default), its handler records the call stack and the stack
+ *    is symbolized on the monitor thread. backtrace() is called once up
+ *    front, so the handler does not end up loading libgcc. Link with
+ *    -rdynamic to get function names. Each signal carries a sequence number
+ *    (sigqueue on Linux) and the handler only records the stack for the
+ *    capture that is still waiting, so a handler that runs after its
+ *    capture timed out can not hand its stack to the next one. Captures
+ *    run without the watchdog's lock; a thread that unregisters while it
+ *    is being captured waits for the capture. The previous handler of the
+ *    signal is restored when the watchdog is destroyed, unless a capture
+ *    timed out and its signal may still arrive.
+ *
+ *    A Handle must not outlive its watchdog.
+ *
+ * Example usage:
+ *    StallWatchdog watchdog(std::chrono::milliseconds(10), [](const StallWatchdog::StallReport& stall) {
+ *       LOG(WARNING) << stall.name << " stalled for " << stall.stalled.count() << " ns";
+ *    });
+ *
+ *    // in the worker thread
+ *    auto heartbeat = watchdog.Register(std::chrono::milliseconds(500), "forwarder");
+ *    while (running) {
+ *       heartbeat.Heartbeat();
+ *       Forward(queue.Pop());
+ *    }
+ */
+
+#pragma once
+#include <pthread.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AlignedNew.h"
+
+class StallWatchdog {
+   struct Slot;
+public:
+   typedef std::chrono::steady_clock clock;
+
+   struct StallReport {
+      std::thread::id threadId;
+      std::string name;
+      std::chrono::nanoseconds stalled;
+      std::vector<std::string> backtrace; // empty unless captureBacktrace
+   };
+   typedef std::function<void (const StallReport&)> StallCallback;
+
+   // Owned by the registered thread, unregisters on destruction
+   class Handle {
+   public:
+      Handle(Handle&& other);
+      ~Handle();
+
+      Handle & operator=(const Handle&) = delete;
+      Handle(const Handle&) = delete;
+
+      void Heartbeat() {
+         mSlot->beats.store(mSlot->beats.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      }
+
+   private:
+      friend class StallWatchdog;
+      Handle(StallWatchdog* watchdog, Slot* slot) : mWatchdog(watchdog), mSlot(slot) {}
+
+      StallWatchdog* mWatchdog;
+      Slot* mSlot;
+   };
+
+   StallWatchdog(std::chrono::milliseconds checkInterval, StallCallback callback,
+                 bool captureBacktrace = false, int backtraceSignal = SIGUSR2);
+   ~StallWatchdog();
+
+   StallWatchdog & operator=(const StallWatchdog&) = delete;
+   StallWatchdog(const StallWatchdog&) = delete;
+
+   // Registers the calling thread
+   Handle Register(std::chrono::milliseconds threshold, const std::string& name = "");
+
+   size_t RegisteredCount();
+   uint64_t StallCount() const { return mStalls.load(std::memory_order_relaxed); }
+
+private:
+   // A cache line per thread so heartbeats do not false share. AlignedNew
+   // as the slots are allocated one by one
+   struct alignas(64) Slot : public AlignedNew<64> {
+      std::atomic<uint64_t> beats;
+      // only touched under mMutex
+      pthread_t thread;
+      std::thread::id threadId;
+      std::string name;
+      clock::duration threshold;
+      uint64_t lastBeats;
+      clock::time_point lastChange;
+      bool reported;
+      bool capturing; // Unregister waits until the backtrace is taken
+   };
+
+   void Unregister(Slot* slot);
+   void MonitorThread();
+   void Check(std::vector<StallReport>& stalls, std::vector<Slot*>& captures);
+   std::vector<std::string> CaptureBacktrace(pthread_t thread);
+
+   const StallCallback mCallback;
+   const clock::duration mCheckInterval;
+   const bool mCaptureBacktrace;
+   const int mBacktraceSignal;
+   std::atomic<uint64_t> mStalls;
+   bool mCaptureTimedOut; // only touched by the monitor thread
+   struct sigaction mPreviousAction;
+   std::mutex mMutex;
+   std::list<std::unique_ptr<Slot>> mSlots;
+   std::condition_variable mWakeUp;
+   std::condition_variable mCaptureDone;
+   bool mStop;
+   std::thread mMonitor;
+};
@@ -0,0 +1,266 @@
+#include "StatsSerialization.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <system_error>
+
+const uint8_t SerializedStats::kVersion;
+const uint8_t SerializedStats::kHistogram;
+
+using stats_serialization::ReadVarint;
+
+namespace {
+   const char kMagic[4] = {'S', 'W', 'T', 'S'};
+   const size_t kHeaderSize = sizeof(kMagic) + 2;
+
+   void WriteVarint(std::string& out, uint64_t value) {
+      while (value >= 0x80) {
+         out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+         value >>= 7;
+      }
+      out.push_back(static_cast<char>(value));
+   }
+
+   uint64_t ZigZag(long long value) {
+      return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+   }
+
+   long long UnZigZag(uint64_t value) {
+      return static_cast<long long>((value >> 1) ^ (~(value & 1) + 1));
+   }
+
+   bool ReadSigned(const uint8_t*& in, const uint8_t* end, long long& value) {
+      uint64_t raw = 0;
+      if (!ReadVarint(in, end, raw)) {
+         return false;
+      }
+      value = UnZigZag(raw);
+      return true;
+   }
+
+   void ThrowErrno(const char* what) {
+      throw std::system_error(errno, std::generic_category(), what);
+   }
+}
+
+SerializedStats::SerializedStats()
+   : mCount(0)
+   , mTotalTime(0)
+   , mMinTime(std::numeric_limits<long long>::max())
+   , mMaxTime(0)
+   , mHasHistogram(false) {}
+
+SerializedStats::SerializedStats(const TimeStats::Metrics& metrics, const LatencyHistogram* histogram)
+   : mCount(std::get<TimeStats::Index::Count>(metrics))
+   , mTotalTime(std::get<TimeStats::Index::TotalTime>(metrics))
+   , mMinTime(std::get<TimeStats::Index::MinTime>(metrics))
+   , mMaxTime(std::get<TimeStats::Index::MaxTime>(metrics))
+   , mHasHistogram(histogram != nullptr) {
+   if (histogram != nullptr) {
+      mHistogram.Merge(*histogram);
+   }
+}
+
+void SerializedStats::MergeCounters(long long count, long long total, long long min, long long max) {
+   if (count == 0) {
+      return;
+   }
+   mCount += count;
+   mTotalTime += total;
+   mMinTime = std::min(mMinTime, min);
+   mMaxTime = std::max(mMaxTime, max);
+}
+
+// A merged histogram must cover every merged measurement, so it is dropped
+// as soon as a record with measurements but without a histogram comes in
+bool SerializedStats::KeepHistogram(long long otherCount, bool otherHasHistogram) {
+   if (otherCount == 0) {
+      return false;
+   }
+   if (mCount == 0) {
+      mHistogram.Reset();
+      mHasHistogram = otherHasHistogram;
+   } else if (mHasHistogram && !otherHasHistogram) {
+      mHistogram.Reset();
+      mHasHistogram = false;
+   }
+   return mHasHistogram;
+}
+
+void SerializedStats::Merge(const SerializedStats& other) {
+   if (KeepHistogram(other.mCount, other.mHasHistogram)) {
+      mHistogram.Merge(other.mHistogram);
+   }
+   MergeCounters(other.mCount, other.mTotalTime, other.mMinTime, other.mMaxTime);
+}
+
+void SerializedStats::Merge(const SerializedStatsView& other) {
+   if (KeepHistogram(other.Count(), other.HasHistogram())) {
+      other.ForEachBucket([this](size_t index, uint64_t count) {
+         mHistogram.AddToBucket(index, count);
+      });
+   }
+   MergeCounters(other.Count(), other.TotalTime(), other.MinTime(), other.MaxTime());
+}
+
+std::string SerializedStats::Serialize() const {
+   std::string out;
+   AppendTo(out);
+   return out;
+}
+
+void SerializedStats::AppendTo(std::string& out) const {
+   std::string body;
+   WriteVarint(body, static_cast<uint64_t>(mCount));
+   WriteVarint(body, ZigZag(mTotalTime));
+   WriteVarint(body, ZigZag(mCount == 0 ? 0 : mMinTime));
+   WriteVarint(body, ZigZag(mMaxTime));
+   if (mHasHistogram) {
+      uint64_t buckets = 0;
+      for (size_t i = 0; i < LatencyHistogram::kBucketCount; ++i) {
+         buckets += (mHistogram.CountAt(i) != 0);
+      }
+      WriteVarint(body, buckets);
+      size_t previous = 0;
+      for (size_t i = 0; i < LatencyHistogram::kBucketCount; ++i) {
+         const uint64_t count = mHistogram.CountAt(i);
+         if (count != 0) {
+            WriteVarint(body, i - previous);
+            WriteVarint(body, count);
+            previous = i;
+         }
+      }
+   }
+
+   out.append(kMagic, sizeof(kMagic));
+   out.push_back(static_cast<char>(kVersion));
+   out.push_back(static_cast<char>(mHasHistogram ? kHistogram : 0));
+   WriteVarint(out, body.size());
+   out += body;
+}
+
+long long SerializedStats::Percentile(double percentile) const {
+   return mHistogram.Percentile(percentile);
+}
+
+TimeStats::Metrics SerializedStats::AsMetrics() const {
+   return std::make_tuple(mMinTime, mMaxTime, mCount, mTotalTime, mCount == 0 ? 0 : mTotalTime / mCount);
+}
+
+SerializedStatsView::SerializedStatsView()
+   : mVersion(0)
+   , mCount(0)
+   , mTotalTime(0)
+   , mMinTime(std::numeric_limits<long long>::max())
+   , mMaxTime(0)
+   , mBuckets(nullptr)
+   , mBodyEnd(nullptr) {}
+
+bool SerializedStatsView::Parse(const uint8_t* data, size_t size, size_t* consumed) {
+   if (size < kHeaderSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+      return false;
+   }
+   const uint8_t version = data[sizeof(kMagic)];
+   const uint8_t flags = data[sizeof(kMagic) + 1];
+   // appended fields keep the version, another version is another layout
+   if (version != SerializedStats::kVersion) {
+      return false;
+   }
+
+   const uint8_t* in = data + kHeaderSize;
+   const uint8_t* end = data + size;
+   uint64_t bodyLength = 0;
+   if (!ReadVarint(in, end, bodyLength) || bodyLength > static_cast<uint64_t>(end - in)) {
+      return false;
+   }
+   end = in + bodyLength;
+
+   uint64_t count = 0;
+   long long total = 0, min = 0, max = 0;
+   if (!ReadVarint(in, end, count) || !ReadSigned(in, end, total) || !ReadSigned(in, end, min) || !ReadSigned(in, end, max)) {
+      return false;
+   }
+
+   const uint8_t* buckets = nullptr;
+   if (flags & SerializedStats::kHistogram) {
+      // validated here once, so ForEachBucket can decode without checks
+      buckets = in;
+      uint64_t bucketCount = 0;
+      if (!ReadVarint(in, end, bucketCount)) {
+         return false;
+      }
+      uint64_t index = 0;
+      for (uint64_t i = 0; i < bucketCount; ++i) {
+         uint64_t delta = 0, bucket = 0;
+         if (!ReadVarint(in, end, delta) || !ReadVarint(in, end, bucket)) {
+            return false;
+         }
+         index += delta;
+         if (index >= LatencyHistogram::kBucketCount) {
+            return false;
+         }
+      }
+   }
+
+   mVersion = version;
+   mCount = static_cast<long long>(count);
+   mTotalTime = total;
+   mMinTime = (count == 0) ? std::numeric_limits<long long>::max() : min;
+   mMaxTime = max;
+   mBuckets = buckets;
+   mBodyEnd = end;
+   if (consumed != nullptr) {
+      *consumed = static_cast<size_t>(end - data);
+   }
+   return true;
+}
+
+SerializedStatsFile::SerializedStatsFile(const std::string& path) : mData(nullptr), mSize(0) {
+   const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd < 0) {
+      ThrowErrno("open");
+   }
+   struct stat info;
+   if (fstat(fd, &info) != 0) {
+      const int error = errno;
+      close(fd);
+      errno = error;
+      ThrowErrno("fstat");
+   }
+   mSize = static_cast<size_t>(info.st_size);
+   if (mSize > 0) {
+      void* mapped = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+         const int error = errno;
+         close(fd);
+         errno = error;
+         ThrowErrno("mmap");
+      }
+      mData = static_cast<const uint8_t*>(mapped);
+   }
+   // the mapping stays valid after the descriptor is closed
+   close(fd);
+}
+
+SerializedStatsFile::~SerializedStatsFile() {
+   if (mData != nullptr) {
+      munmap(const_cast<uint8_t*>(mData), mSize);
+   }
+}
+
+bool SerializedStatsFile::Next(size_t& offset, SerializedStatsView& view) const {
+   if (offset >= mSize) {
+      return false;
+   }
+   size_t consumed = 0;
+   if (!view.Parse(mData + offset, mSize - offset, &consumed)) {
+      return false;
+   }
+   offset += consumed;
+   return true;
+}
@@ -0,0 +1,199 @@
+/*
+ * File:   StatsSerialization.h
+ * Description: A compact, versioned binary format for a stats snapshot, so
+ *    that stats from many processes and hosts can be aggregated exactly
+ *    instead of averaging the averages of FlushAsString text.
+ *
+ *    A record is count, total, min, max and optionally the non-empty
+ *    LatencyHistogram buckets, all as varints. A typical latency
+ *    distribution takes a few hundred bytes. Records merge losslessly, so
+ *    percentiles of merged records are as exact as the histogram (~3%).
+ *
+ *    Layout, integers as LEB128 varints, signed ones zigzag encoded:
+ *       "SWTS" version(1 byte) flags(1 byte) bodyLength
+ *       body: count total(signed) min(signed) max(signed)
+ *             [if flags & kHistogram: buckets, then per bucket: indexDelta count]
+ *    Versioning: new fields are only appended to the end of the body,
+ *    optional ones behind a new flag bit, and they keep the version. A
+ *    reader skips the body bytes after the fields it knows and ignores
+ *    flag bits it does not know, so older readers keep working. The
+ *    version is bumped only for a layout that older readers can not parse,
+ *    e.g. a changed or removed field, and a reader rejects records of any
+ *    version but its own. Records can be concatenated, e.g. appended to
+ *    one file per collector.
+ *
+ *    SerializedStats is an owning, mergeable record. SerializedStatsView
+ *    parses a record in place in a byte buffer without copying, and
+ *    SerializedStatsFile maps a file of concatenated records into memory.
+ *
+ * Example usage:
+ *    // in every collector
+ *    SerializedStats record = SerializedStats::Flush(stats); // stats has EnableHistogram()
+ *    std::string bytes = record.Serialize();
+ *
+ *    // on the aggregator
+ *    SerializedStatsFile file("/var/stats/forwarder.bin");
+ *    SerializedStats fleet;
+ *    SerializedStatsView view;
+ *    for (size_t offset = 0; file.Next(offset, view);) {
+ *       fleet.Merge(view);
+ *    }
+ *    std::cout << fleet.Percentile(99.9) << std::endl;
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "LatencyHistogram.h"
+#include "TimeStats.h"
+
+class SerializedStatsView;
+
+class SerializedStats {
+public:
+   static const uint8_t kVersion = 1; // bumped only for incompatible layouts
+   static const uint8_t kHistogram = 1; // flag
+
+   SerializedStats();
+
+   // Snapshot of the metrics, and of the histogram when given
+   SerializedStats(const TimeStats::Metrics& metrics, const LatencyHistogram* histogram = nullptr);
+
+   // Flushes stats, the histogram is kept if stats has it enabled
+   template<typename Clock> static SerializedStats Flush(BasicTimeStats<Clock>& stats) {
+      LatencyHistogram histogram = stats.Histogram();
+      return SerializedStats(stats.FlushAsMetrics(), histogram.Count() > 0 ? &histogram : nullptr);
+   }
+
+   /**
+    * Adds the other record. The histogram is kept only while every merged
+    * record with measurements has one, a partial histogram would give
+    * percentiles of only some of Count(). Records without measurements
+    * do not matter.
+    */
+   void Merge(const SerializedStats& other);
+   void Merge(const SerializedStatsView& other);
+
+   std::string Serialize() const;
+   void AppendTo(std::string& out) const;
+
+   long long Count() const { return mCount; }
+   long long TotalTime() const { return mTotalTime; }
+   long long MinTime() const { return mMinTime; }
+   long long MaxTime() const { return mMaxTime; }
+   bool HasHistogram() const { return mHasHistogram; }
+   const LatencyHistogram& Histogram() const { return mHistogram; }
+
+   // 0 unless there is a histogram, it covers all of Count()
+   long long Percentile(double percentile) const;
+
+   // Same layout as TimeStats::FlushAsMetrics
+   TimeStats::Metrics AsMetrics() const;
+
+private:
+   void MergeCounters(long long count, long long total, long long min, long long max);
+   bool KeepHistogram(long long otherCount, bool otherHasHistogram);
+
+   long long mCount;
+   long long mTotalTime;
+   long long mMinTime;
+   long long mMaxTime;
+   bool mHasHistogram;
+   LatencyHistogram mHistogram;
+};
+
+/**
+ * A record read in place. The view points into the buffer it was parsed
+ * from, the buffer must outlive it.
+ */
+class SerializedStatsView {
+public:
+   SerializedStatsView();
+
+   /**
+    * Parses the record at data
+    * @param consumed set to the size of the record, to find the next one
+    * @return false if the bytes are not a complete record of kVersion
+    */
+   bool Parse(const uint8_t* data, size_t size, size_t* consumed = nullptr);
+
+   uint8_t Version() const { return mVersion; }
+   long long Count() const { return mCount; }
+   long long TotalTime() const { return mTotalTime; }
+   long long MinTime() const { return mMinTime; }
+   long long MaxTime() const { return mMaxTime; }
+   bool HasHistogram() const { return mBuckets != nullptr; }
+
+   // Decodes the buckets from the buffer, calls visit(index, count) for each
+   template<typename Visit> void ForEachBucket(Visit visit) const;
+
+private:
+   uint8_t mVersion;
+   long long mCount;
+   long long mTotalTime;
+   long long mMinTime;
+   long long mMaxTime;
+   const uint8_t* mBuckets; // the bucket list in the buffer, null if none
+   const uint8_t* mBodyEnd;
+};
+
+/**
+ * A file of concatenated records, memory mapped read only.
+ * Throws std::system_error if the file can not be opened or mapped.
+ */
+class SerializedStatsFile {
+public:
+   explicit SerializedStatsFile(const std::string& path);
+   ~SerializedStatsFile();
+
+   SerializedStatsFile & operator=(const SerializedStatsFile&) = delete;
+   SerializedStatsFile(const SerializedStatsFile&) = delete;
+
+   const uint8_t* Data() const { return mData; }
+   size_t Size() const { return mSize; }
+
+   /**
+    * Parses the record at offset and moves offset past it
+    * @return false at the end of the file or at a record that does not parse
+    */
+   bool Next(size_t& offset, SerializedStatsView& view) const;
+
+private:
+   const uint8_t* mData;
+   size_t mSize;
+};
+
+namespace stats_serialization {
+   // LEB128, returns false if the varint runs past end
+   inline bool ReadVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+      value = 0;
+      for (unsigned shift = 0; shift < 64 && in < end; shift += 7) {
+         const uint8_t byte = *in++;
+         value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+         if ((byte & 0x80) == 0) {
+            return true;
+         }
+      }
+      return false;
+   }
+}
+
+template<typename Visit> void SerializedStatsView::ForEachBucket(Visit visit) const {
+   if (mBuckets == nullptr) {
+      return;
+   }
+   const uint8_t* in = mBuckets;
+   uint64_t buckets = 0;
+   stats_serialization::ReadVarint(in, mBodyEnd, buckets);
+   uint64_t index = 0;
+   for (uint64_t i = 0; i < buckets; ++i) {
+      uint64_t delta = 0;
+      uint64_t count = 0;
+      if (!stats_serialization::ReadVarint(in, mBodyEnd, delta) || !stats_serialization::ReadVarint(in, mBodyEnd, count)) {
+         return;
+      }
+      index += delta;
+      visit(static_cast<size_t>(index), count);
+   }
+}
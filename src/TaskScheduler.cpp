@@ -0,0 +1,207 @@
+#include "TaskScheduler.h"
+#include <stdexcept>
+
+namespace {
+   long long ToNs(TaskScheduler::clock::duration duration) {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+   }
+}
+
+TaskScheduler::TaskScheduler(size_t workers)
+   : mStop(false)
+   , mNextId(1)
+   , mPool(workers) {
+   mDispatcher = std::thread(&TaskScheduler::DispatcherThread, this);
+}
+
+TaskScheduler::~TaskScheduler() {
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStop = true;
+   }
+   mWakeUp.notify_one();
+   mDispatcher.join();
+}
+
+TaskScheduler::TaskId TaskScheduler::SchedulePeriodic(const std::string& name, clock::duration period, Task task, clock::time_point firstRun) {
+   if (period <= clock::duration::zero()) {
+      throw std::invalid_argument("TaskScheduler: the period of " + name + " must be positive");
+   }
+   return Add(name, period, task, firstRun);
+}
+
+TaskScheduler::TaskId TaskScheduler::SchedulePeriodic(const std::string& name, clock::duration period, Task task) {
+   return SchedulePeriodic(name, period, task, clock::now() + period);
+}
+
+TaskScheduler::TaskId TaskScheduler::ScheduleOnce(const std::string& name, clock::time_point runAt, Task task) {
+   return Add(name, clock::duration::zero(), task, runAt);
+}
+
+bool TaskScheduler::Cancel(TaskId id) {
+   std::lock_guard<std::mutex> lock(mMutex);
+   auto it = mTasks.find(id);
+   if (it == mTasks.end() || it->second->finished) {
+      return false;
+   }
+   // the heap entry is dropped lazily when it comes due
+   mTasks.erase(it);
+   return true;
+}
+
+size_t TaskScheduler::TaskCount() {
+   std::lock_guard<std::mutex> lock(mMutex);
+   size_t count = 0;
+   for (auto& task : mTasks) {
+      count += task.second->finished ? 0 : 1;
+   }
+   return count;
+}
+
+bool TaskScheduler::FlushMetrics(TaskId id, TaskMetrics& metrics) {
+   TaskPtr task;
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto it = mTasks.find(id);
+      if (it == mTasks.end()) {
+         return false;
+      }
+      task = it->second;
+      if (task->finished) {
+         mTasks.erase(it);
+      }
+   }
+   metrics = Flush(*task);
+   return true;
+}
+
+std::vector<TaskScheduler::TaskMetrics> TaskScheduler::FlushAllMetrics() {
+   std::vector<TaskPtr> tasks;
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      for (auto it = mTasks.begin(); it != mTasks.end();) {
+         tasks.push_back(it->second);
+         it = it->second->finished ? mTasks.erase(it) : std::next(it);
+      }
+   }
+
+   std::vector<TaskMetrics> all;
+   all.reserve(tasks.size());
+   for (auto& task : tasks) {
+      all.push_back(Flush(*task));
+   }
+   return all;
+}
+
+std::string TaskScheduler::FlushAsString() {
+   std::string str;
+   for (auto& metrics : FlushAllMetrics()) {
+      if (!str.empty()) {
+         str += "\n";
+      }
+      str += metrics.name + ": Runs: " + std::to_string(std::get<TimeStats::Index::Count>(metrics.runTime))
+             + ", Missed: " + std::to_string(metrics.missedRuns)
+             + ", Average lateness: " + std::to_string(std::get<TimeStats::Index::Average>(metrics.lateness) / 1000) + " us"
+             + ", Max lateness: " + std::to_string(std::get<TimeStats::Index::MaxTime>(metrics.lateness) / 1000) + " us"
+             + ", Average run time: " + std::to_string(std::get<TimeStats::Index::Average>(metrics.runTime) / 1000) + " us"
+             + ", Max run time: " + std::to_string(std::get<TimeStats::Index::MaxTime>(metrics.runTime) / 1000) + " us";
+   }
+   return str;
+}
+
+TaskScheduler::TaskId TaskScheduler::Add(const std::string& name, clock::duration period, Task task, clock::time_point firstRun) {
+   auto state = std::make_shared<TaskState>();
+   state->name = name;
+   state->task = task;
+   state->period = period;
+   state->finished = false;
+   state->missedRuns = 0;
+
+   std::lock_guard<std::mutex> lock(mMutex);
+   state->id = mNextId++;
+   mTasks[state->id] = state;
+   Enqueue(state->id, firstRun);
+   return state->id;
+}
+
+// Called with mMutex held
+void TaskScheduler::Enqueue(TaskId id, clock::time_point due) {
+   bool earliest = mDeadlines.empty() || due < mDeadlines.top().due;
+   mDeadlines.push(Deadline{due, id});
+   if (earliest) {
+      mWakeUp.notify_one();
+   }
+}
+
+void TaskScheduler::DispatcherThread() {
+   std::unique_lock<std::mutex> lock(mMutex);
+   while (!mStop) {
+      if (mDeadlines.empty()) {
+         mWakeUp.wait(lock);
+         continue;
+      }
+
+      const Deadline next = mDeadlines.top();
+      if (clock::now() < next.due) {
+         mWakeUp.wait_until(lock, next.due);
+         continue;
+      }
+
+      mDeadlines.pop();
+      auto it = mTasks.find(next.id);
+      if (it == mTasks.end()) {
+         continue; // cancelled
+      }
+      TaskPtr task = it->second;
+      const clock::time_point scheduled = next.due;
+      mPool.Submit([this, task, scheduled] { Execute(task, scheduled); });
+   }
+}
+
+void TaskScheduler::Execute(TaskPtr task, clock::time_point scheduled) {
+   const auto started = clock::now();
+   task->task();
+   const auto done = clock::now();
+
+   uint64_t missed = 0;
+   clock::time_point next = scheduled;
+   if (task->period > clock::duration::zero()) {
+      // stay on the absolute schedule, skipping the periods that were overrun
+      next += task->period;
+      if (next <= done) {
+         auto behind = (done - next) / task->period + 1;
+         missed = static_cast<uint64_t>(behind);
+         next += behind * task->period;
+      }
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(task->statsMutex);
+      task->lateness.Save(ToNs(started - scheduled));
+      task->runTime.Save(ToNs(done - started));
+      task->missedRuns += missed;
+   }
+
+   std::lock_guard<std::mutex> lock(mMutex);
+   auto it = mTasks.find(task->id);
+   if (it == mTasks.end() || it->second != task) {
+      return; // cancelled while running
+   }
+   if (task->period > clock::duration::zero()) {
+      Enqueue(task->id, next);
+   } else {
+      task->finished = true;
+   }
+}
+
+TaskScheduler::TaskMetrics TaskScheduler::Flush(TaskState& task) {
+   std::lock_guard<std::mutex> lock(task.statsMutex);
+   TaskMetrics metrics;
+   metrics.id = task.id;
+   metrics.name = task.name;
+   metrics.lateness = task.lateness.FlushAsMetrics();
+   metrics.runTime = task.runTime.FlushAsMetrics();
+   metrics.missedRuns = task.missedRuns;
+   task.missedRuns = 0;
+   return metrics;
+}
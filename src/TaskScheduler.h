@@ -0,0 +1,129 @@
+/*
+ * File:   TaskScheduler.h
+ * Description: Runs many periodic and one-shot tasks from one dispatcher
+ *    thread and a fixed WorkStealingPool, instead of one AlarmClock thread
+ *    and a polling loop per task.
+ *
+ *    Pending runs are kept in a min-heap keyed by their absolute deadline.
+ *    Periodic tasks are scheduled against their absolute start time, i.e. the
+ *    n:th run is due at start + n * period no matter how late the previous
+ *    runs were, so lateness does not accumulate into drift. If a run overruns
+ *    one or more periods the missed runs are skipped and counted.
+ *
+ *    A periodic task is re-scheduled when its run completes, so the same
+ *    task never runs on two workers at once.
+ *
+ *    Per task the lateness (actual start - scheduled start) and the run time
+ *    are kept as TimeStats, in nanoseconds.
+ *
+ * Example usage:
+ *    TaskScheduler scheduler(2);
+ *    auto id = scheduler.SchedulePeriodic("flush", std::chrono::milliseconds(100), [&] { Flush(); });
+ *    ...
+ *    LOG(INFO) << scheduler.FlushAsString();
+ */
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TimeStats.h"
+#include "WorkStealingPool.h"
+
+class TaskScheduler {
+public:
+   typedef std::chrono::steady_clock clock;
+   typedef uint64_t TaskId;
+   typedef std::function<void ()> Task;
+
+   struct TaskMetrics {
+      TaskId id;
+      std::string name;
+      TimeStats::Metrics lateness;
+      TimeStats::Metrics runTime;
+      uint64_t missedRuns;
+   };
+
+   explicit TaskScheduler(size_t workers);
+   ~TaskScheduler();
+
+   TaskScheduler & operator=(const TaskScheduler&) = delete;
+   TaskScheduler(const TaskScheduler&) = delete;
+
+   /**
+    * Runs the task every period, the first time at firstRun
+    * Throws std::invalid_argument if period is not positive
+    */
+   TaskId SchedulePeriodic(const std::string& name, clock::duration period, Task task, clock::time_point firstRun);
+
+   /**
+    * Runs the task every period, the first time one period from now
+    * Throws std::invalid_argument if period is not positive
+    */
+   TaskId SchedulePeriodic(const std::string& name, clock::duration period, Task task);
+
+   TaskId ScheduleOnce(const std::string& name, clock::time_point runAt, Task task);
+
+   /**
+    * Removes the task. A run that is already executing completes.
+    * @return false if the task is unknown or a one-shot that already ran
+    */
+   bool Cancel(TaskId id);
+
+   size_t TaskCount();
+
+   /**
+    * Flushes (and resets) the lateness and run time stats of one task.
+    * A one-shot task that has run is forgotten once it is flushed.
+    * @return false if the task is unknown
+    */
+   bool FlushMetrics(TaskId id, TaskMetrics& metrics);
+   std::vector<TaskMetrics> FlushAllMetrics();
+   std::string FlushAsString();
+
+private:
+   struct TaskState {
+      TaskId id;
+      std::string name;
+      Task task;
+      clock::duration period; // zero for one-shot tasks
+      bool finished; // one-shot that has run, kept until flushed
+      std::mutex statsMutex;
+      TimeStats lateness;
+      TimeStats runTime;
+      uint64_t missedRuns;
+   };
+
+   struct Deadline {
+      clock::time_point due;
+      TaskId id;
+      bool operator>(const Deadline& other) const {
+         return due > other.due;
+      }
+   };
+
+   typedef std::shared_ptr<TaskState> TaskPtr;
+
+   TaskId Add(const std::string& name, clock::duration period, Task task, clock::time_point firstRun);
+   void Enqueue(TaskId id, clock::time_point due);
+   void DispatcherThread();
+   void Execute(TaskPtr task, clock::time_point scheduled);
+   static TaskMetrics Flush(TaskState& task);
+
+   std::mutex mMutex;
+   std::condition_variable mWakeUp;
+   bool mStop;
+   TaskId mNextId;
+   std::map<TaskId, TaskPtr> mTasks;
+   std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> mDeadlines;
+   WorkStealingPool mPool; // completes queued runs before the state above is destroyed
+   std::thread mDispatcher;
+};
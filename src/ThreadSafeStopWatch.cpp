@@ -1,6 +1,6 @@
 #include "ThreadSafeStopWatch.h"
 
-ThreadSafeStopWatch::ThreadSafeStopWatch() {
+ThreadSafeStopWatch::ThreadSafeStopWatch() : mMutex("ThreadSafeStopWatch") {
 }  
 
 StopWatch& ThreadSafeStopWatch::GetStopWatch()
@@ -9,7 +9,7 @@ StopWatch& ThreadSafeStopWatch::GetStopWatch()
 
    auto it = mStopWatchMap.find(tid);
    if (it == mStopWatchMap.end()) {
-      std::lock_guard<std::mutex> lock(mMutex);
+      std::lock_guard<TimedMutex> lock(mMutex);
       // Lazy barbers lurk here, this should be safe
       it = mStopWatchMap.find(tid);
       if (it == mStopWatchMap.end()) {
@@ -1,5 +1,6 @@
 #pragma once
 #include "StopWatch.h"
+#include "TimedMutex.h"
 #include <mutex>
 #include <map>
 
@@ -12,6 +13,6 @@ public:
    ThreadSafeStopWatch(const ThreadSafeStopWatch&) = delete;
 private:
    typedef std::map<pthread_t, StopWatch> ThreadSafeStopWatchMap;
-   std::mutex mMutex;
+   TimedMutex mMutex;
    ThreadSafeStopWatchMap mStopWatchMap;
 };
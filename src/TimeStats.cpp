@@ -1,60 +1,159 @@
 #include "TimeStats.h"
+#include <atomic>
 #include <limits>
 #include <algorithm>
 
-TimeStats::TimeStats() :
-   mMaxTime(0),
-   mMinTime(std::numeric_limits<long long>::max()),
-   mCount(0),
-   mTotalTime(0) {}
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TIMESTATS_X86_KERNELS 1
+#endif
 
+using time_stats_detail::BatchReduction;
 
-void TimeStats::Save(long long ns) {
-   ++mCount;
-   mTotalTime += ns;
-   mMaxTime = std::max(mMaxTime, ns);
-   mMinTime = std::min(mMinTime, ns);
-}
+namespace {
+   typedef BatchReduction (*BatchKernelFunction)(const int64_t*, size_t);
 
-size_t TimeStats::ElapsedSec() {
-   return mStopWatch.ElapsedSec();
-}
-std::string TimeStats::FlushAsString() {
-   if (0 == mCount) {
-      Reset();
-      return std::string{"Count: 0, no measurements available"};
-   }
-
-   std::string str = {"Count: "};
-   str += std::to_string(mCount)
-          + ", Min time: " + std::to_string(mMinTime)  + " ns"
-          + ", Max time: " + std::to_string(mMaxTime) + " ns : "
-          + std::to_string(mMaxTime / 1000) + " us" +
-          ", Average: " + std::to_string(GetAverage()) + " ns : " + std::to_string(GetAverage() / 1000) + " us";
-   Reset();
-   return str;
-}
+   // Four independent accumulators so that consecutive elements do not wait
+   // on each other's compare and add
+   BatchReduction ReduceScalar(const int64_t* ns, size_t count) {
+      long long min[4] = {std::numeric_limits<long long>::max(), std::numeric_limits<long long>::max(),
+                          std::numeric_limits<long long>::max(), std::numeric_limits<long long>::max()};
+      long long max[4] = {0, 0, 0, 0};
+      long long sum[4] = {0, 0, 0, 0};
+      size_t i = 0;
+      for (; i + 4 <= count; i += 4) {
+         for (size_t lane = 0; lane < 4; ++lane) {
+            long long value = ns[i + lane];
+            min[lane] = std::min(min[lane], value);
+            max[lane] = std::max(max[lane], value);
+            sum[lane] += value;
+         }
+      }
+      for (; i < count; ++i) {
+         min[0] = std::min(min[0], static_cast<long long>(ns[i]));
+         max[0] = std::max(max[0], static_cast<long long>(ns[i]));
+         sum[0] += ns[i];
+      }
+      BatchReduction result;
+      result.min = std::min(std::min(min[0], min[1]), std::min(min[2], min[3]));
+      result.max = std::max(std::max(max[0], max[1]), std::max(max[2], max[3]));
+      result.sum = sum[0] + sum[1] + sum[2] + sum[3];
+      return result;
+   }
 
+#ifdef TIMESTATS_X86_KERNELS
+   __attribute__((target("sse4.2")))
+   BatchReduction ReduceSse42(const int64_t* ns, size_t count) {
+      __m128i min = _mm_set1_epi64x(std::numeric_limits<long long>::max());
+      __m128i max = _mm_setzero_si128();
+      __m128i sum = _mm_setzero_si128();
+      size_t i = 0;
+      for (; i + 2 <= count; i += 2) {
+         __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ns + i));
+         min = _mm_blendv_epi8(min, value, _mm_cmpgt_epi64(min, value));
+         max = _mm_blendv_epi8(max, value, _mm_cmpgt_epi64(value, max));
+         sum = _mm_add_epi64(sum, value);
+      }
 
-TimeStats::Metrics TimeStats::FlushAsMetrics() {
-   TimeStats::Metrics metrics = std::make_tuple(mMinTime, mMaxTime, mCount, mTotalTime, GetAverage());
-   Reset();
-   return metrics;
-}
+      alignas(16) long long lanes[3][2];
+      _mm_store_si128(reinterpret_cast<__m128i*>(lanes[0]), min);
+      _mm_store_si128(reinterpret_cast<__m128i*>(lanes[1]), max);
+      _mm_store_si128(reinterpret_cast<__m128i*>(lanes[2]), sum);
+      BatchReduction tail = ReduceScalar(ns + i, count - i);
+      BatchReduction result;
+      result.min = std::min(std::min(lanes[0][0], lanes[0][1]), tail.min);
+      result.max = std::max(std::max(lanes[1][0], lanes[1][1]), tail.max);
+      result.sum = lanes[2][0] + lanes[2][1] + tail.sum;
+      return result;
+   }
 
-bool TimeStats::HasMetrics() {
-   return (mCount > 0);
-}
+   __attribute__((target("avx2")))
+   BatchReduction ReduceAvx2(const int64_t* ns, size_t count) {
+      __m256i min = _mm256_set1_epi64x(std::numeric_limits<long long>::max());
+      __m256i max = _mm256_setzero_si256();
+      __m256i sum = _mm256_setzero_si256();
+      size_t i = 0;
+      for (; i + 4 <= count; i += 4) {
+         __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ns + i));
+         min = _mm256_blendv_epi8(min, value, _mm256_cmpgt_epi64(min, value));
+         max = _mm256_blendv_epi8(max, value, _mm256_cmpgt_epi64(value, max));
+         sum = _mm256_add_epi64(sum, value);
+      }
+
+      alignas(32) long long lanes[3][4];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[0]), min);
+      _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[1]), max);
+      _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[2]), sum);
+      BatchReduction result = ReduceScalar(ns + i, count - i);
+      for (size_t lane = 0; lane < 4; ++lane) {
+         result.min = std::min(result.min, lanes[0][lane]);
+         result.max = std::max(result.max, lanes[1][lane]);
+         result.sum += lanes[2][lane];
+      }
+      return result;
+   }
+#endif
+
+   struct BatchKernelChoice {
+      BatchKernelFunction function;
+      const char* name;
+   };
+
+   // The kernels this CPU can run, fastest first
+   std::vector<BatchKernelChoice> FindBatchKernels() {
+      std::vector<BatchKernelChoice> kernels;
+#ifdef TIMESTATS_X86_KERNELS
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2")) {
+         kernels.push_back(BatchKernelChoice{ReduceAvx2, "avx2"});
+      }
+      if (__builtin_cpu_supports("sse4.2")) {
+         kernels.push_back(BatchKernelChoice{ReduceSse42, "sse4.2"});
+      }
+#endif
+      kernels.push_back(BatchKernelChoice{ReduceScalar, "scalar"});
+      return kernels;
+   }
 
-long long TimeStats::GetAverage() {
-   if (mCount == 0) {
-      return 0;
+   const std::vector<BatchKernelChoice>& SupportedBatchKernels() {
+      static const std::vector<BatchKernelChoice> kernels = FindBatchKernels();
+      return kernels;
+   }
+
+   std::atomic<size_t> gBatchKernel(0); // index in SupportedBatchKernels()
+
+   const BatchKernelChoice& BatchKernelInUse() {
+      return SupportedBatchKernels()[gBatchKernel.load(std::memory_order_relaxed)];
    }
-   return mTotalTime / mCount;
 }
 
-void TimeStats::Reset() {
-   mCount = mMaxTime = mTotalTime = 0;
-   mMinTime = std::numeric_limits<long long>::max();
-   mStopWatch.Restart();
+namespace time_stats_detail {
+   BatchReduction ReduceBatch(const int64_t* ns, size_t count) {
+      return BatchKernelInUse().function(ns, count);
+   }
+
+   const char* BatchKernel() {
+      return BatchKernelInUse().name;
+   }
+
+   std::vector<std::string> BatchKernels() {
+      std::vector<std::string> names;
+      for (const auto& kernel : SupportedBatchKernels()) {
+         names.push_back(kernel.name);
+      }
+      return names;
+   }
+
+   bool UseBatchKernel(const std::string& name) {
+      const std::vector<BatchKernelChoice>& kernels = SupportedBatchKernels();
+      for (size_t i = 0; i < kernels.size(); ++i) {
+         if (name == kernels[i].name) {
+            gBatchKernel.store(i, std::memory_order_relaxed);
+            return true;
+         }
+      }
+      return false;
+   }
 }
+
+template class BasicTimeStats<std::chrono::steady_clock>;
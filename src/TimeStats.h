@@ -1,7 +1,14 @@
 #pragma once
+#include <chrono>
 #include <string>
 #include <tuple>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
 #include "StopWatch.h"
+#include "LatencyHistogram.h"
 
 /**
 
@@ -26,16 +33,84 @@ while(thread_loop) {
       LOG(INFO) << "Expensive call metrics: " << stats.Flush();
    }
 } // end loop
+
+The interval behind ElapsedSec() is measured with the Clock template
+parameter. TimeStats uses steady_clock, BasicTimeStats<VirtualClock> lets
+tests run the interval in simulated time. The members are defined in this
+header so any clock works, e.g. TscClock or AutoClock.
 */
 
+namespace time_stats_detail {
+   struct BatchReduction {
+      long long min;
+      long long max;
+      long long sum;
+   };
+
+   // Min, max and sum of a batch with the kernel selected for this CPU
+   BatchReduction ReduceBatch(const int64_t* ns, size_t count);
+   const char* BatchKernel();
+   std::vector<std::string> BatchKernels();
+   bool UseBatchKernel(const std::string& name);
+
+   // Orders the slowest first, as a heap comparator it gives a min-heap
+   template<typename Sample> bool SlowerThan(const Sample& a, const Sample& b) {
+      return a.ns > b.ns;
+   }
+}
 
-class TimeStats {
+
+template<typename Clock = std::chrono::steady_clock> class BasicTimeStats {
  public:
 
-   TimeStats();
-   ~TimeStats() = default;
+   // One of the slowest measurements of a flush interval and the caller's
+   // context tag for it, e.g. an event id or a source id
+   struct Sample {
+      long long ns;
+      uint64_t tag;
+   };
+   using Samples = std::vector<Sample>;
+
+   BasicTimeStats();
+
+   /**
+    * Also keeps the keepSlowest slowest measurements of each flush interval
+    * together with their tags. They are kept in a fixed size min-heap so a
+    * measurement that is not among the slowest costs one compare.
+    */
+   explicit BasicTimeStats(size_t keepSlowest);
+   ~BasicTimeStats() = default;
+
+   /**
+    * Also records every measurement in a LatencyHistogram so that
+    * percentiles are available until the next flush
+    */
+   void EnableHistogram();
+
+   void Save(long long ns, uint64_t tag = 0);
+
+   /**
+    * Saves a batch of measurements at once. The batch is reduced to its
+    * min, max and sum with vectorized kernels (AVX2 or SSE4.2 when the CPU
+    * has them, otherwise scalar) and folded into the stats in one step.
+    * The result is identical to calling Save for each element.
+    * The optional tags array runs parallel to ns.
+    */
+   void SaveBatch(const int64_t* ns, size_t count, const uint64_t* tags = nullptr);
+
+   // Name of the kernel SaveBatch uses on this CPU: "avx2", "sse4.2" or "scalar"
+   static const char* BatchKernel() { return time_stats_detail::BatchKernel(); }
+
+   // The kernels this CPU can run, fastest first. The fastest is the default
+   static std::vector<std::string> BatchKernels() { return time_stats_detail::BatchKernels(); }
+
+   /**
+    * Makes SaveBatch use the named kernel, process wide, e.g. to test or
+    * benchmark the slower kernels
+    * @return false if this CPU can not run it
+    */
+   static bool UseBatchKernel(const std::string& name) { return time_stats_detail::UseBatchKernel(name); }
 
-   void Save(long long ns);
    std::string FlushAsString();
    enum Index { MinTime = 0,
                 MaxTime = 1,
@@ -45,19 +120,213 @@ class TimeStats {
               };
 
    using Metrics = std::tuple<long long, long long, long long, long long, long long>;
-    TimeStats::Metrics FlushAsMetrics();
+    Metrics FlushAsMetrics();
+
+   /**
+    * Flushes the metrics and hands over the slowest measurements of the
+    * interval, slowest first. Empty unless constructed with keepSlowest.
+    */
+   Metrics FlushAsMetrics(Samples& slowest);
    size_t ElapsedSec();
    bool HasMetrics();
 
+   /**
+    * @return the percentile (0 - 100) of the measurements since the last
+    *         flush, 0 unless the histogram is enabled
+    */
+   long long Percentile(double percentile) const;
+   const LatencyHistogram& Histogram() const { return mHistogram; }
+
+   // Adds the measurements of other, e.g. per thread stats into a total
+   void Merge(const BasicTimeStats& other);
+
  private:
    void Reset();
    long long GetAverage();
+   void SaveSlowest(long long ns, uint64_t tag);
+   long long SlowestFloor() const;
 
    long long mMaxTime;
    long long mMinTime;
    long long mCount;
    long long mTotalTime;
-   StopWatch mStopWatch;
+   ChronoMeter<Clock> mStopWatch;
+   size_t mKeepSlowest;
+   long long mSlowestFloor; // a measurement must be above this to enter mSlowest
+   Samples mSlowest; // min-heap on ns
+   bool mHistogramEnabled;
+   LatencyHistogram mHistogram;
+
+
+};
+
+
+template<typename Clock> BasicTimeStats<Clock>::BasicTimeStats() : BasicTimeStats(0) {}
+
+template<typename Clock> BasicTimeStats<Clock>::BasicTimeStats(size_t keepSlowest) :
+   mMaxTime(0),
+   mMinTime(std::numeric_limits<long long>::max()),
+   mCount(0),
+   mTotalTime(0),
+   mKeepSlowest(keepSlowest),
+   mHistogramEnabled(false) {
+   mSlowest.reserve(mKeepSlowest);
+   mSlowestFloor = SlowestFloor();
+}
 
 
-};
\ No newline at end of file
+template<typename Clock> void BasicTimeStats<Clock>::Save(long long ns, uint64_t tag) {
+   ++mCount;
+   mTotalTime += ns;
+   mMaxTime = std::max(mMaxTime, ns);
+   mMinTime = std::min(mMinTime, ns);
+   if (ns > mSlowestFloor) {
+      SaveSlowest(ns, tag);
+   }
+   if (mHistogramEnabled) {
+      mHistogram.Record(ns);
+   }
+}
+
+template<typename Clock> void BasicTimeStats<Clock>::SaveBatch(const int64_t* ns, size_t count, const uint64_t* tags) {
+   if (count == 0) {
+      return;
+   }
+   time_stats_detail::BatchReduction batch = time_stats_detail::ReduceBatch(ns, count);
+   mCount += count;
+   mTotalTime += batch.sum;
+   mMaxTime = std::max(mMaxTime, batch.max);
+   mMinTime = std::min(mMinTime, batch.min);
+   if (batch.max > mSlowestFloor) {
+      for (size_t i = 0; i < count; ++i) {
+         if (ns[i] > mSlowestFloor) {
+            SaveSlowest(ns[i], tags ? tags[i] : 0);
+         }
+      }
+   }
+   if (mHistogramEnabled) {
+      for (size_t i = 0; i < count; ++i) {
+         mHistogram.Record(ns[i]);
+      }
+   }
+}
+
+template<typename Clock> void BasicTimeStats<Clock>::EnableHistogram() {
+   mHistogramEnabled = true;
+}
+
+template<typename Clock> long long BasicTimeStats<Clock>::Percentile(double percentile) const {
+   return mHistogram.Percentile(percentile);
+}
+
+template<typename Clock> void BasicTimeStats<Clock>::Merge(const BasicTimeStats& other) {
+   mCount += other.mCount;
+   mTotalTime += other.mTotalTime;
+   mMaxTime = std::max(mMaxTime, other.mMaxTime);
+   mMinTime = std::min(mMinTime, other.mMinTime);
+   for (const auto& sample : other.mSlowest) {
+      if (sample.ns > mSlowestFloor) {
+         SaveSlowest(sample.ns, sample.tag);
+      }
+   }
+   if (mHistogramEnabled) {
+      mHistogram.Merge(other.mHistogram);
+   }
+}
+
+template<typename Clock> size_t BasicTimeStats<Clock>::ElapsedSec() {
+   return mStopWatch.ElapsedSec();
+}
+template<typename Clock> std::string BasicTimeStats<Clock>::FlushAsString() {
+   if (0 == mCount) {
+      Reset();
+      return std::string{"Count: 0, no measurements available"};
+   }
+
+   std::string str = {"Count: "};
+   str += std::to_string(mCount)
+          + ", Min time: " + std::to_string(mMinTime)  + " ns"
+          + ", Max time: " + std::to_string(mMaxTime) + " ns : "
+          + std::to_string(mMaxTime / 1000) + " us" +
+          ", Average: " + std::to_string(GetAverage()) + " ns : " + std::to_string(GetAverage() / 1000) + " us";
+   if (mHistogram.Count() > 0) {
+      str += ", p50: " + std::to_string(Percentile(50)) + " ns"
+             + ", p99: " + std::to_string(Percentile(99)) + " ns"
+             + ", p99.9: " + std::to_string(Percentile(99.9)) + " ns";
+   }
+   if (!mSlowest.empty()) {
+      Samples slowest(mSlowest);
+      std::sort(slowest.begin(), slowest.end(), time_stats_detail::SlowerThan<Sample>);
+      str += ", Slowest:";
+      for (const auto& sample : slowest) {
+         str += " " + std::to_string(sample.ns) + " ns (tag " + std::to_string(sample.tag) + ")";
+      }
+   }
+   Reset();
+   return str;
+}
+
+
+template<typename Clock> typename BasicTimeStats<Clock>::Metrics BasicTimeStats<Clock>::FlushAsMetrics() {
+   Metrics metrics = std::make_tuple(mMinTime, mMaxTime, mCount, mTotalTime, GetAverage());
+   Reset();
+   return metrics;
+}
+
+template<typename Clock> typename BasicTimeStats<Clock>::Metrics BasicTimeStats<Clock>::FlushAsMetrics(Samples& slowest) {
+   slowest.assign(mSlowest.begin(), mSlowest.end());
+   std::sort(slowest.begin(), slowest.end(), time_stats_detail::SlowerThan<Sample>);
+   return FlushAsMetrics();
+}
+
+template<typename Clock> bool BasicTimeStats<Clock>::HasMetrics() {
+   return (mCount > 0);
+}
+
+template<typename Clock> long long BasicTimeStats<Clock>::GetAverage() {
+   if (mCount == 0) {
+      return 0;
+   }
+   return mTotalTime / mCount;
+}
+
+template<typename Clock> void BasicTimeStats<Clock>::Reset() {
+   mCount = mMaxTime = mTotalTime = 0;
+   mMinTime = std::numeric_limits<long long>::max();
+   mSlowest.clear();
+   mSlowestFloor = SlowestFloor();
+   mHistogram.Reset();
+   mStopWatch.Restart();
+}
+
+// Only called for measurements above mSlowestFloor
+template<typename Clock> void BasicTimeStats<Clock>::SaveSlowest(long long ns, uint64_t tag) {
+   if (mSlowest.size() == mKeepSlowest) {
+      std::pop_heap(mSlowest.begin(), mSlowest.end(), time_stats_detail::SlowerThan<Sample>);
+      mSlowest.back() = Sample{ns, tag};
+   } else {
+      mSlowest.push_back(Sample{ns, tag});
+   }
+   std::push_heap(mSlowest.begin(), mSlowest.end(), time_stats_detail::SlowerThan<Sample>);
+   mSlowestFloor = SlowestFloor();
+}
+
+template<typename Clock> long long BasicTimeStats<Clock>::SlowestFloor() const {
+   if (mKeepSlowest == 0) {
+      return std::numeric_limits<long long>::max();
+   }
+   if (mSlowest.size() < mKeepSlowest) {
+      return std::numeric_limits<long long>::min();
+   }
+   return mSlowest.front().ns;
+}
+
+// Instantiated in TimeStats.cpp
+extern template class BasicTimeStats<std::chrono::steady_clock>;
+
+// A class and not an alias, so that "class TimeStats;" still declares it
+class TimeStats : public BasicTimeStats<> {
+ public:
+   using BasicTimeStats::BasicTimeStats;
+};
+
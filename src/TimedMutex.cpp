@@ -0,0 +1,94 @@
+#include "TimedMutex.h"
+
+const unsigned TimedMutex::kDefaultHoldSampleEvery;
+
+std::string LockStats::AsString() const {
+   return name + ": Acquisitions: " + std::to_string(acquisitions)
+          + ", Contended: " + std::to_string(contended)
+          + ", Average wait: " + std::to_string(AverageWaitNs()) + " ns"
+          + ", Max wait: " + std::to_string(waitMaxNs) + " ns"
+          + ", Average hold: " + std::to_string(AverageHoldNs()) + " ns"
+          + ", Max hold: " + std::to_string(holdMaxNs) + " ns";
+}
+
+LockMetrics::LockMetrics(const std::string& name)
+   : mName(name)
+   , mAcquisitions(0)
+   , mContended(0)
+   , mWaitTotalNs(0)
+   , mWaitMaxNs(0)
+   , mHoldSamples(0)
+   , mHoldTotalNs(0)
+   , mHoldMaxNs(0) {
+   LockRegistry::Instance().Add(this);
+}
+
+LockMetrics::~LockMetrics() {
+   LockRegistry::Instance().Remove(this);
+}
+
+LockStats LockMetrics::Stats() const {
+   LockStats stats;
+   stats.name = mName;
+   stats.acquisitions = mAcquisitions.load(std::memory_order_relaxed);
+   stats.contended = mContended.load(std::memory_order_relaxed);
+   stats.waitTotalNs = mWaitTotalNs.load(std::memory_order_relaxed);
+   stats.waitMaxNs = mWaitMaxNs.load(std::memory_order_relaxed);
+   stats.holdSamples = mHoldSamples.load(std::memory_order_relaxed);
+   stats.holdTotalNs = mHoldTotalNs.load(std::memory_order_relaxed);
+   stats.holdMaxNs = mHoldMaxNs.load(std::memory_order_relaxed);
+   return stats;
+}
+
+LockRegistry& LockRegistry::Instance() {
+   // never destroyed, locks in static objects unregister during exit
+   static LockRegistry* registry = new LockRegistry;
+   return *registry;
+}
+
+void LockRegistry::Add(const LockMetrics* metrics) {
+   std::lock_guard<std::mutex> lock(mMutex);
+   mMetrics.push_back(metrics);
+}
+
+void LockRegistry::Remove(const LockMetrics* metrics) {
+   std::lock_guard<std::mutex> lock(mMutex);
+   auto it = std::find(mMetrics.begin(), mMetrics.end(), metrics);
+   if (it != mMetrics.end()) {
+      *it = mMetrics.back();
+      mMetrics.pop_back();
+   }
+}
+
+size_t LockRegistry::Size() {
+   std::lock_guard<std::mutex> lock(mMutex);
+   return mMetrics.size();
+}
+
+std::vector<LockStats> LockRegistry::TopContended(size_t count) {
+   std::vector<LockStats> stats;
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      stats.reserve(mMetrics.size());
+      for (const LockMetrics* metrics : mMetrics) {
+         stats.push_back(metrics->Stats());
+      }
+   }
+   count = std::min(count, stats.size());
+   std::partial_sort(stats.begin(), stats.begin() + count, stats.end(),
+                     [](const LockStats& a, const LockStats& b) { return a.waitTotalNs > b.waitTotalNs; });
+   stats.resize(count);
+   return stats;
+}
+
+std::string LockRegistry::TopContendedAsString(size_t count) {
+   const std::vector<LockStats> top = TopContended(count);
+   if (top.empty()) {
+      return std::string{"No locks registered"};
+   }
+   std::string str;
+   for (const auto& stats : top) {
+      str += (str.empty() ? "" : "\n") + stats.AsString();
+   }
+   return str;
+}
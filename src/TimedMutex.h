@@ -0,0 +1,281 @@
+/*
+ * File:   TimedMutex.h
+ * Description: Drop-in replacements for std::mutex and
+ *    std::shared_timed_mutex that record how long threads wait to acquire
+ *    the lock and how long they hold it.
+ *
+ *    An acquisition first tries the lock. When that succeeds (uncontended)
+ *    no clock is read, except for every holdSampleEvery:th acquisition which
+ *    is sampled for hold time. When the lock is contended the wait is
+ *    timed, and the clock read that ends the wait also starts the hold
+ *    time, so a contended acquisition is always sampled.
+ *
+ *    The exclusive stats are only written by the lock holder, so they are
+ *    plain relaxed stores without read-modify-write. Shared acquisitions of
+ *    a TimedSharedMutex run concurrently and use fetch_add. Their hold time
+ *    is not measured.
+ *
+ *    Every lock registers itself in the LockRegistry, which lists the most
+ *    contended locks of the process.
+ *
+ * Example usage:
+ *    TimedMutex mutex("session table");
+ *    {
+ *       std::lock_guard<TimedMutex> lock(mutex);
+ *       ...
+ *    }
+ *    LOG(INFO) << LockRegistry::Instance().TopContendedAsString(5);
+ */
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+struct LockStats {
+   std::string name;
+   uint64_t acquisitions;
+   uint64_t contended;
+   long long waitTotalNs;
+   long long waitMaxNs;
+   uint64_t holdSamples;
+   long long holdTotalNs;
+   long long holdMaxNs;
+
+   double ContendedShare() const { return acquisitions == 0 ? 0 : static_cast<double>(contended) / acquisitions; }
+   long long AverageWaitNs() const { return contended == 0 ? 0 : waitTotalNs / static_cast<long long>(contended); }
+   long long AverageHoldNs() const { return holdSamples == 0 ? 0 : holdTotalNs / static_cast<long long>(holdSamples); }
+   std::string AsString() const;
+};
+
+// The counters behind one lock, or behind the shared side of one lock
+class LockMetrics {
+public:
+   explicit LockMetrics(const std::string& name);
+   ~LockMetrics();
+
+   LockMetrics & operator=(const LockMetrics&) = delete;
+   LockMetrics(const LockMetrics&) = delete;
+
+   // Only called by the exclusive holder: load and store, no read-modify-write
+   uint64_t CountExclusive() {
+      const uint64_t acquisitions = mAcquisitions.load(std::memory_order_relaxed) + 1;
+      mAcquisitions.store(acquisitions, std::memory_order_relaxed);
+      return acquisitions;
+   }
+
+   void WaitedExclusive(long long ns) {
+      mContended.store(mContended.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      mWaitTotalNs.store(mWaitTotalNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+      if (ns > mWaitMaxNs.load(std::memory_order_relaxed)) {
+         mWaitMaxNs.store(ns, std::memory_order_relaxed);
+      }
+   }
+
+   void Held(long long ns) {
+      mHoldSamples.store(mHoldSamples.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      mHoldTotalNs.store(mHoldTotalNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+      if (ns > mHoldMaxNs.load(std::memory_order_relaxed)) {
+         mHoldMaxNs.store(ns, std::memory_order_relaxed);
+      }
+   }
+
+   // Concurrent holders, e.g. shared acquisitions
+   void CountShared() {
+      mAcquisitions.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   void WaitedShared(long long ns) {
+      mContended.fetch_add(1, std::memory_order_relaxed);
+      mWaitTotalNs.fetch_add(ns, std::memory_order_relaxed);
+      long long current = mWaitMaxNs.load(std::memory_order_relaxed);
+      while (ns > current && !mWaitMaxNs.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+      }
+   }
+
+   LockStats Stats() const;
+
+private:
+   const std::string mName;
+   std::atomic<uint64_t> mAcquisitions;
+   std::atomic<uint64_t> mContended;
+   std::atomic<long long> mWaitTotalNs;
+   std::atomic<long long> mWaitMaxNs;
+   std::atomic<uint64_t> mHoldSamples;
+   std::atomic<long long> mHoldTotalNs;
+   std::atomic<long long> mHoldMaxNs;
+};
+
+// All live TimedMutex and TimedSharedMutex metrics of the process
+class LockRegistry {
+public:
+   static LockRegistry& Instance();
+
+   // Sorted on total wait time, most contended first
+   std::vector<LockStats> TopContended(size_t count);
+   std::string TopContendedAsString(size_t count);
+   size_t Size();
+
+private:
+   friend class LockMetrics;
+   LockRegistry() = default;
+   void Add(const LockMetrics* metrics);
+   void Remove(const LockMetrics* metrics);
+
+   std::mutex mMutex;
+   std::vector<const LockMetrics*> mMetrics;
+};
+
+namespace timed_mutex_detail {
+   inline long long NowNs() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now().time_since_epoch()).count();
+   }
+}
+
+class TimedMutex {
+public:
+   static const unsigned kDefaultHoldSampleEvery = 64;
+
+   /**
+    * @param holdSampleEvery measure the hold time of every n:th
+    *        uncontended acquisition, 0 only measures contended ones
+    */
+   explicit TimedMutex(const std::string& name = "TimedMutex", unsigned holdSampleEvery = kDefaultHoldSampleEvery)
+      : mMetrics(name)
+      , mHoldSampleEvery(holdSampleEvery)
+      , mHoldStartNs(0) {}
+
+   TimedMutex & operator=(const TimedMutex&) = delete;
+   TimedMutex(const TimedMutex&) = delete;
+
+   void lock() {
+      if (mMutex.try_lock()) {
+         Acquired(0);
+         return;
+      }
+      const long long start = timed_mutex_detail::NowNs();
+      mMutex.lock();
+      const long long acquired = timed_mutex_detail::NowNs();
+      mMetrics.WaitedExclusive(acquired - start);
+      Acquired(acquired);
+   }
+
+   bool try_lock() {
+      if (!mMutex.try_lock()) {
+         return false;
+      }
+      Acquired(0);
+      return true;
+   }
+
+   void unlock() {
+      if (mHoldStartNs != 0) {
+         mMetrics.Held(timed_mutex_detail::NowNs() - mHoldStartNs);
+         mHoldStartNs = 0;
+      }
+      mMutex.unlock();
+   }
+
+   LockStats Stats() const { return mMetrics.Stats(); }
+
+private:
+   // with the lock held, acquiredNs is 0 unless the clock was already read
+   void Acquired(long long acquiredNs) {
+      const uint64_t acquisitions = mMetrics.CountExclusive();
+      if (acquiredNs == 0 && mHoldSampleEvery != 0 && acquisitions % mHoldSampleEvery == 0) {
+         acquiredNs = timed_mutex_detail::NowNs();
+      }
+      mHoldStartNs = acquiredNs;
+   }
+
+   std::mutex mMutex;
+   LockMetrics mMetrics;
+   const unsigned mHoldSampleEvery;
+   long long mHoldStartNs; // 0 if this hold is not sampled
+};
+
+class TimedSharedMutex {
+public:
+   explicit TimedSharedMutex(const std::string& name = "TimedSharedMutex",
+                             unsigned holdSampleEvery = TimedMutex::kDefaultHoldSampleEvery)
+      : mMetrics(name)
+      , mSharedMetrics(name + " (shared)")
+      , mHoldSampleEvery(holdSampleEvery)
+      , mHoldStartNs(0) {}
+
+   TimedSharedMutex & operator=(const TimedSharedMutex&) = delete;
+   TimedSharedMutex(const TimedSharedMutex&) = delete;
+
+   void lock() {
+      if (mMutex.try_lock()) {
+         Acquired(0);
+         return;
+      }
+      const long long start = timed_mutex_detail::NowNs();
+      mMutex.lock();
+      const long long acquired = timed_mutex_detail::NowNs();
+      mMetrics.WaitedExclusive(acquired - start);
+      Acquired(acquired);
+   }
+
+   bool try_lock() {
+      if (!mMutex.try_lock()) {
+         return false;
+      }
+      Acquired(0);
+      return true;
+   }
+
+   void unlock() {
+      if (mHoldStartNs != 0) {
+         mMetrics.Held(timed_mutex_detail::NowNs() - mHoldStartNs);
+         mHoldStartNs = 0;
+      }
+      mMutex.unlock();
+   }
+
+   void lock_shared() {
+      if (!mMutex.try_lock_shared()) {
+         const long long start = timed_mutex_detail::NowNs();
+         mMutex.lock_shared();
+         mSharedMetrics.WaitedShared(timed_mutex_detail::NowNs() - start);
+      }
+      mSharedMetrics.CountShared();
+   }
+
+   bool try_lock_shared() {
+      if (!mMutex.try_lock_shared()) {
+         return false;
+      }
+      mSharedMetrics.CountShared();
+      return true;
+   }
+
+   void unlock_shared() {
+      mMutex.unlock_shared();
+   }
+
+   LockStats Stats() const { return mMetrics.Stats(); }
+   LockStats SharedStats() const { return mSharedMetrics.Stats(); }
+
+private:
+   void Acquired(long long acquiredNs) {
+      const uint64_t acquisitions = mMetrics.CountExclusive();
+      if (acquiredNs == 0 && mHoldSampleEvery != 0 && acquisitions % mHoldSampleEvery == 0) {
+         acquiredNs = timed_mutex_detail::NowNs();
+      }
+      mHoldStartNs = acquiredNs;
+   }
+
+   std::shared_timed_mutex mMutex;
+   LockMetrics mMetrics;
+   LockMetrics mSharedMetrics;
+   const unsigned mHoldSampleEvery;
+   long long mHoldStartNs;
+};
@@ -0,0 +1,272 @@
+#include "TimerLoop.h"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+namespace {
+   const size_t kNotInHeap = static_cast<size_t>(-1);
+   const int kMaxEvents = 2;
+
+   void ThrowErrno(const char* what) {
+      throw std::system_error(errno, std::generic_category(), what);
+   }
+
+   struct timespec ToTimespec(TimerLoop::clock::time_point tp) {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+      struct timespec ts;
+      ts.tv_sec = ns / 1000000000;
+      ts.tv_nsec = ns % 1000000000;
+      return ts;
+   }
+}
+
+TimerLoop::Waiter::Waiter() : mLoop(nullptr), mHeapIndex(kNotInHeap) {}
+
+TimerLoop::Waiter::~Waiter() {
+   if (mLoop != nullptr) {
+      try {
+         mLoop->Detach(*this);
+      } catch (const std::system_error&) {
+         // re-arming the timerfd failed, the waiter is out of the heap anyway
+         // and a destructor must not throw
+      }
+   }
+}
+
+TimerLoop::TimerLoop() : mEpollFd(-1), mTimerFd(-1), mEventFd(-1), mStopRequested(false), mArmed(false) {
+   mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+   if (mEpollFd < 0) {
+      ThrowErrno("epoll_create1");
+   }
+   mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+   mEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (mTimerFd < 0 || mEventFd < 0) {
+      const char* failed = (mTimerFd < 0) ? "timerfd_create" : "eventfd";
+      int error = errno;
+      CloseAll();
+      errno = error;
+      ThrowErrno(failed);
+   }
+
+   for (int fd : {mTimerFd, mEventFd}) {
+      struct epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+      if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+         int error = errno;
+         CloseAll();
+         errno = error;
+         ThrowErrno("epoll_ctl");
+      }
+   }
+}
+
+TimerLoop::~TimerLoop() {
+   // Waiters that outlive the loop must not point back to it
+   for (auto waiter : mHeap) {
+      waiter->mLoop = nullptr;
+   }
+   for (auto waiter : mCancelled) {
+      waiter->mLoop = nullptr;
+   }
+   CloseAll();
+}
+
+void TimerLoop::CloseAll() {
+   for (int* fd : {&mEventFd, &mTimerFd, &mEpollFd}) {
+      if (*fd >= 0) {
+         close(*fd);
+         *fd = -1;
+      }
+   }
+}
+
+void TimerLoop::Schedule(Waiter& waiter, clock::time_point deadline) {
+   if (waiter.mLoop != nullptr) {
+      waiter.mLoop->Detach(waiter);
+   }
+   waiter.mLoop = this;
+   waiter.mDeadline = deadline;
+   HeapPush(&waiter);
+   ArmTimer();
+}
+
+bool TimerLoop::Cancel(Waiter& waiter) {
+   if (waiter.mLoop != this || waiter.mHeapIndex == kNotInHeap) {
+      return false;
+   }
+   HeapRemove(waiter.mHeapIndex);
+   mCancelled.push_back(&waiter);
+   ArmTimer();
+   return true;
+}
+
+size_t TimerLoop::RunOnce(int timeoutMs) {
+   if (!mCancelled.empty()) {
+      timeoutMs = 0;
+   }
+
+   struct epoll_event events[kMaxEvents];
+   int ready = epoll_wait(mEpollFd, events, kMaxEvents, timeoutMs);
+   if (ready < 0 && errno != EINTR) {
+      ThrowErrno("epoll_wait");
+   }
+
+   for (int i = 0; i < ready; ++i) {
+      uint64_t drain = 0;
+      if (events[i].data.fd == mEventFd) {
+         mStopRequested = (read(mEventFd, &drain, sizeof(drain)) == sizeof(drain)) || mStopRequested;
+      } else {
+         // the expiration count is not used, the heap is the source of truth
+         (void)read(mTimerFd, &drain, sizeof(drain));
+      }
+   }
+
+   size_t woken = WakeCancelled();
+   woken += WakeExpired();
+   ArmTimer();
+   return woken;
+}
+
+void TimerLoop::Run() {
+   mStopRequested = false;
+   while (!mStopRequested && PendingCount() > 0) {
+      RunOnce();
+   }
+}
+
+void TimerLoop::Stop() {
+   uint64_t one = 1;
+   (void)write(mEventFd, &one, sizeof(one));
+}
+
+void TimerLoop::Reserve(size_t waits) {
+   mHeap.reserve(waits);
+   mCancelled.reserve(waits);
+}
+
+void TimerLoop::Detach(Waiter& waiter) {
+   waiter.mLoop = nullptr;
+   if (waiter.mHeapIndex != kNotInHeap) {
+      HeapRemove(waiter.mHeapIndex);
+      ArmTimer();
+   } else {
+      auto it = std::find(mCancelled.begin(), mCancelled.end(), &waiter);
+      if (it != mCancelled.end()) {
+         mCancelled.erase(it);
+      }
+   }
+}
+
+size_t TimerLoop::WakeCancelled() {
+   size_t woken = 0;
+   while (!mCancelled.empty()) {
+      Waiter* waiter = mCancelled.back();
+      mCancelled.pop_back();
+      waiter->mLoop = nullptr;
+      waiter->OnWake(false);
+      ++woken;
+   }
+   return woken;
+}
+
+size_t TimerLoop::WakeExpired() {
+   size_t woken = 0;
+   const auto now = clock::now();
+   while (!mHeap.empty() && mHeap.front()->mDeadline <= now) {
+      Waiter* waiter = mHeap.front();
+      HeapRemove(0);
+      waiter->mLoop = nullptr;
+      // may resume a coroutine that destroys or re-schedules the waiter
+      waiter->OnWake(true);
+      ++woken;
+   }
+   return woken;
+}
+
+void TimerLoop::ArmTimer() {
+   const bool arm = !mHeap.empty();
+   const clock::time_point deadline = arm ? mHeap.front()->mDeadline : clock::time_point();
+   if (arm == mArmed && (!arm || deadline == mArmedDeadline)) {
+      return;
+   }
+
+   struct itimerspec spec = {};
+   if (arm) {
+      spec.it_value = ToTimespec(deadline);
+      if (spec.it_value.tv_sec <= 0 && spec.it_value.tv_nsec <= 0) {
+         // all zero would disarm the timer, a deadline at or before the
+         // epoch is due now
+         spec.it_value.tv_sec = 0;
+         spec.it_value.tv_nsec = 1;
+      }
+   }
+   if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+      ThrowErrno("timerfd_settime");
+   }
+   mArmed = arm;
+   mArmedDeadline = deadline;
+}
+
+void TimerLoop::HeapPush(Waiter* waiter) {
+   mHeap.push_back(waiter);
+   waiter->mHeapIndex = mHeap.size() - 1;
+   SiftUp(waiter->mHeapIndex);
+}
+
+void TimerLoop::HeapRemove(size_t index) {
+   Waiter* removed = mHeap[index];
+   Waiter* last = mHeap.back();
+   mHeap.pop_back();
+   removed->mHeapIndex = kNotInHeap;
+   if (last == removed) {
+      return;
+   }
+
+   Place(last, index);
+   SiftUp(index);
+   SiftDown(last->mHeapIndex);
+}
+
+void TimerLoop::SiftUp(size_t index) {
+   Waiter* waiter = mHeap[index];
+   while (index > 0) {
+      size_t parent = (index - 1) / 2;
+      if (!(waiter->mDeadline < mHeap[parent]->mDeadline)) {
+         break;
+      }
+      Place(mHeap[parent], index);
+      index = parent;
+   }
+   Place(waiter, index);
+}
+
+void TimerLoop::SiftDown(size_t index) {
+   Waiter* waiter = mHeap[index];
+   const size_t size = mHeap.size();
+   while (true) {
+      size_t child = 2 * index + 1;
+      if (child >= size) {
+         break;
+      }
+      if (child + 1 < size && mHeap[child + 1]->mDeadline < mHeap[child]->mDeadline) {
+         ++child;
+      }
+      if (!(mHeap[child]->mDeadline < waiter->mDeadline)) {
+         break;
+      }
+      Place(mHeap[child], index);
+      index = child;
+   }
+   Place(waiter, index);
+}
+
+void TimerLoop::Place(Waiter* waiter, size_t index) {
+   mHeap[index] = waiter;
+   waiter->mHeapIndex = index;
+}
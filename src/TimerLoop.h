@@ -0,0 +1,127 @@
+/*
+ * File:   TimerLoop.h
+ * Description: A single threaded event loop that multiplexes any number of
+ *    timers onto one timerfd watched by epoll. Pending waits are kept in a
+ *    binary min-heap keyed by their absolute deadline and the timerfd is only
+ *    re-armed when the earliest deadline changes.
+ *
+ *    A wait is an intrusive "Waiter" owned by the caller. The loop stores
+ *    pointers only, so once the heap has grown to its high water mark no
+ *    wait allocates memory.
+ *
+ *    All calls except Stop() must be made from the thread that runs the loop.
+ *    For C++20 coroutines see AwaitableTimer.h
+ *
+ * Example usage:
+ *    TimerLoop loop;
+ *    TimerLoop::Callback flush([&](bool expired) { if (expired) { Flush(); } });
+ *    loop.Schedule(flush, TimerLoop::clock::now() + std::chrono::milliseconds(10));
+ *    loop.Run(); // returns when no timers are pending or Stop() was called
+ */
+
+#pragma once
+#include <chrono>
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+class TimerLoop {
+public:
+   typedef std::chrono::steady_clock clock;
+
+   class Waiter {
+   public:
+      Waiter();
+      virtual ~Waiter();
+
+      bool Pending() const { return mLoop != nullptr; }
+      clock::time_point Deadline() const { return mDeadline; }
+
+      Waiter & operator=(const Waiter&) = delete;
+      Waiter(const Waiter&) = delete;
+
+   protected:
+      // Called on the loop thread. expired is false if the wait was cancelled.
+      // The waiter is no longer pending when this is called and may be
+      // destroyed or scheduled again from within the call.
+      virtual void OnWake(bool expired) = 0;
+
+   private:
+      friend class TimerLoop;
+      TimerLoop* mLoop;
+      clock::time_point mDeadline;
+      size_t mHeapIndex;
+   };
+
+   // A waiter that calls a function on wake. The function is set once so
+   // re-scheduling the same Callback does not allocate.
+   class Callback : public Waiter {
+   public:
+      explicit Callback(std::function<void (bool)> onWake) : mOnWake(onWake) {}
+
+   protected:
+      void OnWake(bool expired) override { mOnWake(expired); }
+
+   private:
+      std::function<void (bool)> mOnWake;
+   };
+
+   // throws std::system_error if epoll, timerfd or eventfd cannot be created
+   TimerLoop();
+   ~TimerLoop();
+
+   TimerLoop & operator=(const TimerLoop&) = delete;
+   TimerLoop(const TimerLoop&) = delete;
+
+   /**
+    * Schedules the waiter to wake at the deadline. A waiter that is already
+    * pending is moved to the new deadline.
+    */
+   void Schedule(Waiter& waiter, clock::time_point deadline);
+
+   /**
+    * Cancels a pending wait. The waiter is woken with expired == false on the
+    * next loop iteration, never from within Cancel itself.
+    * @return false if the waiter was not pending
+    */
+   bool Cancel(Waiter& waiter);
+
+   /**
+    * Waits for at most timeoutMs (-1 is forever) and wakes every waiter that
+    * expired or was cancelled
+    * @return the number of waiters that were woken
+    */
+   size_t RunOnce(int timeoutMs = -1);
+
+   // Runs until Stop() is called or no waits are pending
+   void Run();
+
+   // Makes Run() return. This is the only call that is safe from other threads
+   void Stop();
+
+   size_t PendingCount() const { return mHeap.size() + mCancelled.size(); }
+
+   // Pre-sizes the internal storage for the given number of concurrent waits
+   void Reserve(size_t waits);
+
+private:
+   void CloseAll();
+   void Detach(Waiter& waiter);
+   void HeapPush(Waiter* waiter);
+   void HeapRemove(size_t index);
+   void SiftUp(size_t index);
+   void SiftDown(size_t index);
+   void Place(Waiter* waiter, size_t index);
+   void ArmTimer();
+   size_t WakeCancelled();
+   size_t WakeExpired();
+
+   int mEpollFd;
+   int mTimerFd;
+   int mEventFd;
+   bool mStopRequested;
+   bool mArmed; // the timerfd is set to mArmedDeadline
+   clock::time_point mArmedDeadline;
+   std::vector<Waiter*> mHeap;
+   std::vector<Waiter*> mCancelled;
+};
@@ -21,16 +21,18 @@ while(thread_loop) {
       func();
    } // scope exits and `func` is measured.
 }
+
+BasicTriggerTimeStats<Clock> measures with Clock, e.g. VirtualClock in tests.
 */
-class TriggerTimeStats {
+template<typename Clock = std::chrono::steady_clock> class BasicTriggerTimeStats {
  public:
-   TriggerTimeStats(TimeStats& timeStats)
+   BasicTriggerTimeStats(BasicTimeStats<Clock>& timeStats)
       : mTimeStats(timeStats)
       , mSkip(false) {
       mStopWatch.Restart();
    }
 
-   ~TriggerTimeStats() {
+   ~BasicTriggerTimeStats() {
       if (!mSkip) {
          mTimeStats.Save(mStopWatch.ElapsedNs());
 
@@ -43,7 +45,9 @@ class TriggerTimeStats {
 
 
  private:
-   TimeStats& mTimeStats;
-   StopWatch mStopWatch;
+   BasicTimeStats<Clock>& mTimeStats;
+   ChronoMeter<Clock> mStopWatch;
    bool mSkip;
-};
\ No newline at end of file
+};
+
+using TriggerTimeStats = BasicTriggerTimeStats<>;
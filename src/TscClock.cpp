@@ -0,0 +1,67 @@
+#include "TscClock.h"
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+const bool TscClock::is_steady;
+
+namespace {
+   const std::chrono::milliseconds kCalibrationTime(10);
+
+   // Reads the TSC and steady_clock as close together as possible. The pair
+   // with the shortest read window of a few attempts is used.
+   void ReadPair(uint64_t& ticks, std::chrono::steady_clock::time_point& steady) {
+      uint64_t best = UINT64_MAX;
+      for (int attempt = 0; attempt < 5; ++attempt) {
+         uint64_t before = TscClock::Ticks();
+         auto now = std::chrono::steady_clock::now();
+         uint64_t after = TscClock::Ticks();
+         if (after - before < best) {
+            best = after - before;
+            ticks = before + (after - before) / 2;
+            steady = now;
+         }
+      }
+   }
+}
+
+TscClock::Calibration TscClock::Calibrate() {
+   Calibration calibration;
+#if defined(__x86_64__) || defined(__i386__)
+   uint64_t startTicks = 0;
+   uint64_t endTicks = 0;
+   std::chrono::steady_clock::time_point start;
+   std::chrono::steady_clock::time_point end;
+   ReadPair(startTicks, start);
+   std::this_thread::sleep_for(kCalibrationTime);
+   ReadPair(endTicks, end);
+
+   const double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+   const double ticks = static_cast<double>(endTicks - startTicks);
+   calibration.ticksPerSecond = ticks / ns * 1e9;
+   calibration.multiplier = static_cast<uint64_t>(ns / ticks * static_cast<double>(1ull << kShift));
+#else
+   calibration.ticksPerSecond = 1e9;
+   calibration.multiplier = 1ull << kShift;
+#endif
+   return calibration;
+}
+
+double TscClock::TicksPerSecond() {
+   return Calibrated().ticksPerSecond;
+}
+
+bool TscClock::Invariant() {
+#if defined(__x86_64__) || defined(__i386__)
+   unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+   if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007) {
+      return false;
+   }
+   __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+   return (edx & (1u << 8)) != 0;
+#else
+   return true;
+#endif
+}
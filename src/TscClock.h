@@ -0,0 +1,77 @@
+/*
+ * File:   TscClock.h
+ * Description: A std::chrono compatible clock that reads the CPU time stamp
+ *    counter. Reading it is a few nanoseconds and never enters the kernel.
+ *    The counter frequency is calibrated against steady_clock on first use
+ *    (about 10 ms) and ticks are converted to nanoseconds with a fixed point
+ *    multiply and shift.
+ *
+ *    is_steady is a compile time constant and is true, but the clock is only
+ *    steady on CPUs with an invariant TSC. Without one the TSC rate follows
+ *    frequency scaling and may stop in deep sleep states. Check Invariant()
+ *    at startup before relying on TscClock, or use AutoClock which only
+ *    selects the TSC when it is invariant.
+ *    On other architectures it falls back to steady_clock.
+ *
+ * Example usage:
+ *    TscStopWatch sw;  // i.e. ChronoMeter<TscClock>
+ *    sw.ElapsedNs();
+ */
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include "StopWatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+class TscClock {
+public:
+   typedef std::chrono::nanoseconds duration;
+   typedef duration::rep rep;
+   typedef duration::period period;
+   typedef std::chrono::time_point<TscClock> time_point;
+   static const bool is_steady = true; // requires Invariant(), see above
+
+   static time_point now() noexcept {
+      return time_point(duration(static_cast<rep>(ToNs(Ticks()))));
+   }
+
+   static uint64_t Ticks() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+   }
+
+   static uint64_t ToNs(uint64_t ticks) noexcept {
+      const Calibration& calibration = Calibrated();
+      return static_cast<uint64_t>((static_cast<unsigned __int128>(ticks) * calibration.multiplier) >> kShift);
+   }
+
+   static double TicksPerSecond();
+
+   // true if the CPU reports an invariant (constant rate, non-stop) TSC
+   static bool Invariant();
+
+private:
+   static const unsigned kShift = 32;
+
+   struct Calibration {
+      uint64_t multiplier; // ns per tick << kShift
+      double ticksPerSecond;
+   };
+
+   static Calibration Calibrate();
+
+   static const Calibration& Calibrated() noexcept {
+      static const Calibration calibration = Calibrate();
+      return calibration;
+   }
+};
+
+using TscStopWatch = ChronoMeter<TscClock>;
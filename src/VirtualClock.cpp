@@ -0,0 +1,4 @@
+#include "VirtualClock.h"
+
+const bool VirtualClock::is_steady;
+std::atomic<VirtualClock::rep> VirtualClock::mNowNs(0);
@@ -0,0 +1,56 @@
+/*
+ * File:   VirtualClock.h
+ * Description: A std::chrono compatible clock whose time only moves when
+ *    Advance() is called. It can be used wherever a clock type is a template
+ *    parameter, ChronoMeter, AlarmClock, BasicTimeStats and
+ *    BasicTriggerTimeStats, so that tests run in simulated time: no real
+ *    sleeps and no dependency on how loaded the machine is.
+ *
+ *    The time is process wide and starts at the epoch. It never goes
+ *    backwards, so tests should work with time relative to now().
+ *
+ * Example usage:
+ *    AlarmClock<std::chrono::seconds, VirtualClock> alerter(10);
+ *    VirtualClock::Advance(std::chrono::seconds(10));
+ *    while (!alerter.Expired()); // returns after microseconds of real time
+ */
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "StopWatch.h"
+
+class VirtualClock {
+public:
+   typedef std::chrono::nanoseconds duration;
+   typedef duration::rep rep;
+   typedef duration::period period;
+   typedef std::chrono::time_point<VirtualClock> time_point;
+   static const bool is_steady = true;
+
+   static time_point now() noexcept {
+      return time_point(duration(mNowNs.load(std::memory_order_acquire)));
+   }
+
+   // Moves the time forward, a negative duration is ignored
+   template<typename Rep, typename Period>
+   static time_point Advance(std::chrono::duration<Rep, Period> step) noexcept {
+      const rep ns = std::chrono::duration_cast<duration>(step).count();
+      return time_point(duration(ns > 0 ? mNowNs.fetch_add(ns, std::memory_order_acq_rel) + ns : mNowNs.load()));
+   }
+
+   // Moves the time forward to tp, a tp in the past is ignored
+   static time_point AdvanceTo(time_point tp) noexcept {
+      rep current = mNowNs.load(std::memory_order_acquire);
+      const rep target = tp.time_since_epoch().count();
+      while (current < target && !mNowNs.compare_exchange_weak(current, target, std::memory_order_acq_rel)) {
+      }
+      return now();
+   }
+
+private:
+   static std::atomic<rep> mNowNs;
+};
+
+using VirtualStopWatch = ChronoMeter<VirtualClock>;
@@ -0,0 +1,223 @@
+/*
+ * File:   WallClockConverter.h
+ * Description: Maps time points of a monotonic clock (steady_clock,
+ *    high_resolution_clock, TscClock ...) to UTC epoch nanoseconds, e.g. to
+ *    put a StopWatch or ConcurrentTimeStats timestamp on a log line without
+ *    calling system_clock::now() per event.
+ *
+ *    A calibration pairs a clock reading with a system_clock reading (the
+ *    pair with the narrowest read window out of a few attempts). The mapping
+ *    is anchorUtc + (t - anchorClock) * rate, one multiply-add.
+ *
+ *    The rate is the ratio of wall time to clock time between the last two
+ *    calibrations, which follows NTP slewing, clamped to +-500 ppm. A
+ *    resync does not jump to the new calibration. The new mapping starts
+ *    where the old one is at the resync point, and the difference to the
+ *    wall clock is slewed away over the next resync interval at up to
+ *    500 ppm on top of the rate. Conversions are therefore monotonic and
+ *    continuous across resyncs.
+ *
+ *    A wall clock step too large to slew within one interval, e.g. settimeofday
+ *    or an NTP step, is applied as a step. Conversions are NOT monotonic
+ *    across that resync, a later time point can convert to an earlier wall
+ *    time if the wall clock was stepped back. The interval with the step is
+ *    not used to estimate the rate.
+ *
+ *    By default a background thread re-calibrates periodically. The mapping
+ *    is published under a seqlock so ToUtcNs is lock free on all threads.
+ *
+ *    EstimatedError() is the half width of the calibration read window plus
+ *    how far the previous mapping was off at the last resync (the offset
+ *    that is being slewed away, or the step).
+ *
+ *    The wall clock is a template parameter so tests can step it, it is
+ *    system_clock otherwise.
+ *
+ * Example usage:
+ *    WallClockConverter<std::chrono::steady_clock> toWall;
+ *    auto snapshot = stats.Snapshot();
+ *    LOG(INFO) << toWall.ToUtcNs(snapshot.taken) << " " << snapshot.count;
+ */
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+template<typename Clock = std::chrono::steady_clock, typename WallClock = std::chrono::system_clock>
+class WallClockConverter {
+public:
+   typedef typename Clock::time_point time_point;
+
+   /**
+    * @param resyncInterval how often to re-calibrate in the background,
+    *        zero disables the background thread (call Resync() yourself)
+    */
+   explicit WallClockConverter(std::chrono::milliseconds resyncInterval = std::chrono::milliseconds(1000))
+      : mSequence(0)
+      , mAnchorClockNs(0)
+      , mAnchorUtcNs(0)
+      , mRate(1.0)
+      , mErrorNs(0)
+      , mCalibrated(false)
+      , mBaseRate(1.0)
+      , mPairClockNs(0)
+      , mPairUtcNs(0)
+      , mStop(false)
+      , mInterval(resyncInterval) {
+      Resync();
+      if (mInterval.count() > 0) {
+         mResyncThread = std::thread(&WallClockConverter::ResyncThread, this);
+      }
+   }
+
+   ~WallClockConverter() {
+      {
+         std::lock_guard<std::mutex> lock(mMutex);
+         mStop = true;
+      }
+      mWakeUp.notify_one();
+      if (mResyncThread.joinable()) {
+         mResyncThread.join();
+      }
+   }
+
+   WallClockConverter & operator=(const WallClockConverter&) = delete;
+   WallClockConverter(const WallClockConverter&) = delete;
+
+   int64_t ToUtcNs(time_point tp) const {
+      const int64_t clockNs = ToNs(tp.time_since_epoch());
+      int64_t anchorClockNs, anchorUtcNs;
+      double rate;
+      uint64_t before, after;
+      do {
+         before = mSequence.load(std::memory_order_acquire);
+         anchorClockNs = mAnchorClockNs.load(std::memory_order_relaxed);
+         anchorUtcNs = mAnchorUtcNs.load(std::memory_order_relaxed);
+         rate = mRate.load(std::memory_order_relaxed);
+         std::atomic_thread_fence(std::memory_order_acquire);
+         after = mSequence.load(std::memory_order_relaxed);
+      } while ((before & 1) || before != after);
+
+      return anchorUtcNs + static_cast<int64_t>(static_cast<double>(clockNs - anchorClockNs) * rate);
+   }
+
+   std::chrono::system_clock::time_point ToSystemTime(time_point tp) const {
+      return std::chrono::system_clock::time_point(
+         std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(ToUtcNs(tp))));
+   }
+
+   std::chrono::nanoseconds EstimatedError() const {
+      return std::chrono::nanoseconds(mErrorNs.load(std::memory_order_relaxed));
+   }
+
+   double Rate() const {
+      return mRate.load(std::memory_order_relaxed);
+   }
+
+   // Re-calibrates now. Calls are serialized with the background thread
+   void Resync() {
+      std::lock_guard<std::mutex> resync(mResyncMutex);
+      int64_t clockNs = 0;
+      int64_t utcNs = 0;
+      int64_t windowNs = 0;
+      ReadPair(clockNs, utcNs, windowNs);
+
+      if (!mCalibrated || clockNs <= mPairClockNs) {
+         Publish(clockNs, utcNs, mBaseRate);
+         mCalibrated = true;
+         mPairClockNs = clockNs;
+         mPairUtcNs = utcNs;
+         mErrorNs.store(windowNs / 2, std::memory_order_relaxed);
+         return;
+      }
+
+      const int64_t elapsedNs = clockNs - mPairClockNs;
+      const int64_t predictedUtcNs = mAnchorUtcNs.load(std::memory_order_relaxed)
+         + static_cast<int64_t>(static_cast<double>(clockNs - mAnchorClockNs.load(std::memory_order_relaxed)) * mRate.load(std::memory_order_relaxed));
+      const int64_t offsetNs = utcNs - predictedUtcNs;
+      const int64_t slewNs = (mInterval.count() > 0) ? ToNs(mInterval) : elapsedNs;
+      const double correction = static_cast<double>(offsetNs) / static_cast<double>(slewNs);
+      if (correction > kMaxSlew || correction < -kMaxSlew) {
+         // a step of the wall clock, it says nothing about the rate
+         Publish(clockNs, utcNs, mBaseRate);
+      } else {
+         const double measured = static_cast<double>(utcNs - mPairUtcNs) / static_cast<double>(elapsedNs);
+         mBaseRate = std::min(kMaxRate, std::max(kMinRate, measured));
+         Publish(clockNs, predictedUtcNs, mBaseRate + correction);
+      }
+      mPairClockNs = clockNs;
+      mPairUtcNs = utcNs;
+      mErrorNs.store(windowNs / 2 + (offsetNs < 0 ? -offsetNs : offsetNs), std::memory_order_relaxed);
+   }
+
+private:
+   static constexpr double kMinRate = 1.0 - 500e-6;
+   static constexpr double kMaxRate = 1.0 + 500e-6;
+   static constexpr double kMaxSlew = 500e-6;
+   static const int kReadAttempts = 5;
+
+   template<typename Duration> static int64_t ToNs(Duration d) {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+   }
+
+   void Publish(int64_t anchorClockNs, int64_t anchorUtcNs, double rate) {
+      const uint64_t sequence = mSequence.load(std::memory_order_relaxed);
+      mSequence.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      mAnchorClockNs.store(anchorClockNs, std::memory_order_relaxed);
+      mAnchorUtcNs.store(anchorUtcNs, std::memory_order_relaxed);
+      mRate.store(rate, std::memory_order_relaxed);
+      mSequence.store(sequence + 2, std::memory_order_release);
+   }
+
+   static void ReadPair(int64_t& clockNs, int64_t& utcNs, int64_t& windowNs) {
+      windowNs = INT64_MAX;
+      for (int attempt = 0; attempt < kReadAttempts; ++attempt) {
+         const int64_t before = ToNs(Clock::now().time_since_epoch());
+         const int64_t utc = ToNs(WallClock::now().time_since_epoch());
+         const int64_t after = ToNs(Clock::now().time_since_epoch());
+         if (after - before < windowNs) {
+            windowNs = after - before;
+            clockNs = before + (after - before) / 2;
+            utcNs = utc;
+         }
+      }
+   }
+
+   void ResyncThread() {
+      std::unique_lock<std::mutex> lock(mMutex);
+      while (!mWakeUp.wait_for(lock, mInterval, [this] { return mStop; })) {
+         lock.unlock();
+         Resync();
+         lock.lock();
+      }
+   }
+
+   std::atomic<uint64_t> mSequence;
+   std::atomic<int64_t> mAnchorClockNs;
+   std::atomic<int64_t> mAnchorUtcNs;
+   std::atomic<double> mRate;
+   std::atomic<int64_t> mErrorNs;
+
+   // only used by Resync, under mResyncMutex
+   bool mCalibrated;
+   double mBaseRate; // the measured rate, without the slew
+   int64_t mPairClockNs; // the last calibration
+   int64_t mPairUtcNs;
+
+   std::mutex mResyncMutex;
+   std::mutex mMutex;
+   std::condition_variable mWakeUp;
+   bool mStop;
+   const std::chrono::milliseconds mInterval;
+   std::thread mResyncThread;
+};
+
+template<typename Clock, typename WallClock> constexpr double WallClockConverter<Clock, WallClock>::kMinRate;
+template<typename Clock, typename WallClock> constexpr double WallClockConverter<Clock, WallClock>::kMaxRate;
+template<typename Clock, typename WallClock> constexpr double WallClockConverter<Clock, WallClock>::kMaxSlew;
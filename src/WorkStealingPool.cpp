@@ -0,0 +1,93 @@
+#include "WorkStealingPool.h"
+
+WorkStealingPool::WorkStealingPool(size_t workers)
+   : mNextQueue(0)
+   , mQueued(0)
+   , mStolen(0)
+   , mStop(false) {
+   if (workers == 0) {
+      workers = 1;
+   }
+   for (size_t i = 0; i < workers; ++i) {
+      mQueues.emplace_back(new Queue);
+   }
+   for (size_t i = 0; i < workers; ++i) {
+      mWorkers.emplace_back(&WorkStealingPool::WorkerThread, this, i);
+   }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+   {
+      std::lock_guard<std::mutex> lock(mIdleMutex);
+      mStop = true;
+   }
+   mIdle.notify_all();
+   for (auto& worker : mWorkers) {
+      worker.join();
+   }
+}
+
+void WorkStealingPool::Submit(Work work) {
+   {
+      // counted first so the count never drops below the queued work, and
+      // under the idle lock so a worker about to wait cannot miss it
+      std::lock_guard<std::mutex> lock(mIdleMutex);
+      mQueued.fetch_add(1, std::memory_order_release);
+   }
+   Queue& queue = *mQueues[mNextQueue.fetch_add(1, std::memory_order_relaxed) % mQueues.size()];
+   {
+      std::lock_guard<std::mutex> lock(queue.mMutex);
+      queue.mWork.push_back(std::move(work));
+   }
+   mIdle.notify_one();
+}
+
+void WorkStealingPool::WorkerThread(size_t index) {
+   Work work;
+   while (true) {
+      if (TakeOwn(index, work) || Steal(index, work)) {
+         mQueued.fetch_sub(1, std::memory_order_acq_rel);
+         work();
+         work = nullptr;
+         continue;
+      }
+
+      if (mQueued.load(std::memory_order_acquire) > 0) {
+         // counted but not yet pushed, or briefly locked by a thief
+         std::this_thread::yield();
+         continue;
+      }
+
+      std::unique_lock<std::mutex> lock(mIdleMutex);
+      mIdle.wait(lock, [this] { return mStop || mQueued.load(std::memory_order_acquire) > 0; });
+      if (mStop && mQueued.load(std::memory_order_acquire) == 0) {
+         return;
+      }
+   }
+}
+
+bool WorkStealingPool::TakeOwn(size_t index, Work& work) {
+   Queue& queue = *mQueues[index];
+   std::lock_guard<std::mutex> lock(queue.mMutex);
+   if (queue.mWork.empty()) {
+      return false;
+   }
+   work = std::move(queue.mWork.front());
+   queue.mWork.pop_front();
+   return true;
+}
+
+bool WorkStealingPool::Steal(size_t index, Work& work) {
+   for (size_t i = 1; i < mQueues.size(); ++i) {
+      Queue& victim = *mQueues[(index + i) % mQueues.size()];
+      std::unique_lock<std::mutex> lock(victim.mMutex, std::try_to_lock);
+      if (!lock.owns_lock() || victim.mWork.empty()) {
+         continue;
+      }
+      work = std::move(victim.mWork.back());
+      victim.mWork.pop_back();
+      mStolen.fetch_add(1, std::memory_order_relaxed);
+      return true;
+   }
+   return false;
+}
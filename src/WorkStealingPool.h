@@ -0,0 +1,54 @@
+/*
+ * File:   WorkStealingPool.h
+ * Description: A fixed size pool of worker threads. Every worker owns a
+ *    queue. Submitted work is spread round robin over the queues, a worker
+ *    takes from the front of its own queue and when that is empty it steals
+ *    from the back of the other queues, so one slow job does not hold up the
+ *    work queued behind it.
+ *
+ *    Work that is queued when the pool is destroyed is still executed.
+ */
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+public:
+   typedef std::function<void ()> Work;
+
+   explicit WorkStealingPool(size_t workers);
+   ~WorkStealingPool();
+
+   WorkStealingPool & operator=(const WorkStealingPool&) = delete;
+   WorkStealingPool(const WorkStealingPool&) = delete;
+
+   void Submit(Work work);
+   size_t Size() const { return mWorkers.size(); }
+   uint64_t StolenCount() const { return mStolen.load(std::memory_order_relaxed); }
+
+private:
+   struct Queue {
+      std::mutex mMutex;
+      std::deque<Work> mWork;
+   };
+
+   void WorkerThread(size_t index);
+   bool TakeOwn(size_t index, Work& work);
+   bool Steal(size_t index, Work& work);
+
+   std::vector<std::unique_ptr<Queue>> mQueues;
+   std::atomic<size_t> mNextQueue;
+   std::atomic<size_t> mQueued;
+   std::atomic<uint64_t> mStolen;
+   std::mutex mIdleMutex;
+   std::condition_variable mIdle;
+   bool mStop;
+   std::vector<std::thread> mWorkers;
+};
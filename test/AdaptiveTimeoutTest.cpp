@@ -0,0 +1,109 @@
+#include "AdaptiveTimeoutTest.h"
+#include "AdaptiveTimeout.h"
+#include "VirtualClock.h"
+#include <chrono>
+#include <thread>
+
+namespace {
+   typedef std::chrono::microseconds microseconds;
+   typedef std::chrono::milliseconds milliseconds;
+   typedef AdaptiveTimeout<milliseconds> MsTimeout;
+
+   MsTimeout::Config SmallWindow() {
+      MsTimeout::Config config;
+      config.percentile = 99;
+      config.multiplier = 2;
+      config.minTimeout = milliseconds(5);
+      config.maxTimeout = milliseconds(1000);
+      config.initialTimeout = milliseconds(100);
+      config.window = 100;
+      config.historySize = 4;
+      return config;
+   }
+}
+
+TEST_F(AdaptiveTimeoutTest, InitialTimeoutUntilFirstWindow) {
+   MsTimeout timeout(SmallWindow());
+   EXPECT_EQ(milliseconds(100), timeout.Timeout());
+   for (int i = 0; i < 99; ++i) {
+      timeout.Observe(milliseconds(20));
+   }
+   EXPECT_EQ(milliseconds(100), timeout.Timeout());
+   timeout.Observe(milliseconds(20));
+   // p99 of 20 ms is reported as its bucket's upper bound, within 3%
+   EXPECT_GE(timeout.Timeout(), milliseconds(40));
+   EXPECT_LE(timeout.Timeout(), milliseconds(42));
+}
+
+TEST_F(AdaptiveTimeoutTest, ClampedToBounds) {
+   MsTimeout timeout(SmallWindow());
+   for (int i = 0; i < 100; ++i) {
+      timeout.Observe(microseconds(10));
+   }
+   EXPECT_EQ(milliseconds(5), timeout.Timeout());
+   for (int i = 0; i < 200; ++i) {
+      timeout.Observe(std::chrono::seconds(3));
+   }
+   EXPECT_EQ(milliseconds(1000), timeout.Timeout());
+}
+
+TEST_F(AdaptiveTimeoutTest, OldWindowsAgeOut) {
+   MsTimeout timeout(SmallWindow());
+   for (int i = 0; i < 100; ++i) {
+      timeout.Observe(milliseconds(200));
+   }
+   EXPECT_GE(timeout.Timeout(), milliseconds(400));
+   // the slow window is still part of the estimate one window later
+   for (int i = 0; i < 100; ++i) {
+      timeout.Observe(milliseconds(10));
+   }
+   EXPECT_GE(timeout.Timeout(), milliseconds(400));
+   for (int i = 0; i < 100; ++i) {
+      timeout.Observe(milliseconds(10));
+   }
+   EXPECT_LE(timeout.Timeout(), milliseconds(21));
+}
+
+TEST_F(AdaptiveTimeoutTest, BackoffDoublesUpToMax) {
+   MsTimeout timeout(SmallWindow());
+   timeout.Backoff();
+   EXPECT_EQ(milliseconds(200), timeout.Timeout());
+   for (int i = 0; i < 5; ++i) {
+      timeout.Backoff();
+   }
+   EXPECT_EQ(milliseconds(1000), timeout.Timeout());
+}
+
+TEST_F(AdaptiveTimeoutTest, HistoryIsARing) {
+   MsTimeout timeout(SmallWindow());
+   EXPECT_EQ(1u, timeout.History().size());
+   for (int i = 0; i < 5; ++i) {
+      timeout.Backoff();
+   }
+   auto history = timeout.History();
+   ASSERT_EQ(4u, history.size());
+   EXPECT_EQ(400000000, history[0].timeoutNs);
+   EXPECT_EQ(1000000000, history[3].timeoutNs);
+
+   TimeStats::Metrics metrics = timeout.HistoryAsMetrics();
+   EXPECT_EQ(4, std::get<TimeStats::Index::Count>(metrics));
+   EXPECT_EQ(400000000, std::get<TimeStats::Index::MinTime>(metrics));
+   EXPECT_EQ(1000000000, std::get<TimeStats::Index::MaxTime>(metrics));
+   EXPECT_EQ("Timeout: 1000000 us, p99 x 2, Estimates: 0", timeout.AsString());
+}
+
+TEST_F(AdaptiveTimeoutTest, ArmsAlarmWithEstimate) {
+   MsTimeout timeout(SmallWindow());
+   for (int i = 0; i < 100; ++i) {
+      timeout.Observe(milliseconds(20));
+   }
+   AlarmClock<milliseconds, VirtualClock> alarm(1000000);
+   timeout.Arm(alarm);
+   EXPECT_EQ(timeout.Timeout().count() * 1000, alarm.SleepTimeUs());
+   VirtualClock::Advance(timeout.Timeout() - milliseconds(1));
+   std::this_thread::sleep_for(milliseconds(1));
+   EXPECT_FALSE(alarm.Expired());
+   VirtualClock::Advance(milliseconds(1));
+   while (!alarm.Expired());
+   EXPECT_TRUE(alarm.Expired());
+}
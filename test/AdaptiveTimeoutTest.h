@@ -0,0 +1,22 @@
+/*
+ * File:   AdaptiveTimeoutTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class AdaptiveTimeoutTest : public ::testing::Test {
+public:
+
+   AdaptiveTimeoutTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
@@ -9,6 +9,7 @@
 #include "AlarmClockTest.h"
 #include "AlarmClock.h"
 #include "StopWatch.h"
+#include "VirtualClock.h"
 #include <chrono>
 #include <iostream>
 #include <thread>
@@ -23,8 +24,8 @@ namespace {
 
    unsigned int kFakeSleepLeeway = 100;
 
-   template<typename T>
-   void WaitForAlarmClockToExpire(AlarmClock<T>& alerter) {
+   template<typename T, typename Clock>
+   void WaitForAlarmClockToExpire(AlarmClock<T, Clock>& alerter) {
       while (!alerter.Expired());
    }
 
@@ -33,6 +34,13 @@ namespace {
       return static_cast<int>(std::chrono::duration_cast<microseconds>(t).count());
    }
 
+   // A subclass written against the protected interface of earlier versions
+   class LegacyAlarm : public AlarmClock<milliseconds> {
+   public:
+      explicit LegacyAlarm(unsigned int ms) : AlarmClock<milliseconds>(ms) {}
+      using AlarmClock<milliseconds>::ExpireAtUs;
+   };
+
    bool FakeSleep(unsigned int usToSleep) {
       AlarmClockTest::mFakeSleepUs.store(usToSleep);
       std::this_thread::sleep_for(microseconds(10));
@@ -213,3 +221,144 @@ TEST_F(AlarmClockTest, milliseconds_MultipleResetsMixed) {
    WaitForAlarmClockToExpire(alerter);
    EXPECT_TRUE(alerter.Expired());
 }
+
+TEST_F(AlarmClockTest, ResetWithNewDuration) {
+   int ms = 7500;
+   AlarmClock<milliseconds> alerter(ms);
+   EXPECT_FALSE(alerter.Expired());
+   alerter.Reset(5);
+   EXPECT_EQ(ConvertToMicroSeconds(milliseconds(5)), alerter.SleepTimeUs());
+   StopWatch sw;
+   WaitForAlarmClockToExpire(alerter);
+   EXPECT_TRUE(alerter.Expired());
+   EXPECT_LT(sw.ElapsedMs(), static_cast<uint64_t>(ms));
+}
+
+TEST_F(AlarmClockTest, ResetWithNewDurationAfterExpired) {
+   AlarmClock<milliseconds> alerter(1);
+   WaitForAlarmClockToExpire(alerter);
+   alerter.Reset(10);
+   EXPECT_FALSE(alerter.Expired());
+   StopWatch sw;
+   WaitForAlarmClockToExpire(alerter);
+   EXPECT_GE(sw.ElapsedUs(), static_cast<uint64_t>(ConvertToMicroSeconds(milliseconds(10)) - 1000));
+}
+
+TEST_F(AlarmClockTest, ArmAtDeadline) {
+   AlarmClock<seconds> alerter(1000);
+   auto deadline = std::chrono::steady_clock::now() + milliseconds(20);
+   alerter.ArmAt(deadline);
+   EXPECT_FALSE(alerter.Expired());
+   WaitForAlarmClockToExpire(alerter);
+   EXPECT_TRUE(std::chrono::steady_clock::now() >= deadline);
+}
+
+TEST_F(AlarmClockTest, ArmAtDeadlineInThePast) {
+   AlarmClock<seconds> alerter(1000);
+   alerter.ArmAt(std::chrono::steady_clock::now() - seconds(1));
+   EXPECT_EQ(0, alerter.SleepTimeUs());
+   WaitForAlarmClockToExpire(alerter);
+   EXPECT_EQ(0, alerter.Remaining().count());
+}
+
+TEST_F(AlarmClockTest, RemainingCountsDown) {
+   AlarmClock<seconds> alerter(1000);
+   auto first = alerter.Remaining();
+   EXPECT_LE(first.count(), ConvertToMicroSeconds(seconds(1000)));
+   EXPECT_GT(first.count(), ConvertToMicroSeconds(seconds(999)));
+   std::this_thread::sleep_for(milliseconds(2));
+   EXPECT_LT(alerter.Remaining(), first);
+}
+
+TEST_F(AlarmClockTest, ExpiryRacingWithResetIsDiscarded) {
+   // The fake sleep always reports expiry, so every re-arm races with it.
+   // After each re-arm the alarm must expire again, never stay stuck.
+   AlarmClock<microseconds> alerter(100, FakeSleep);
+   for (int i = 0; i < 100; ++i) {
+      alerter.Reset(100 + i);
+      WaitForAlarmClockToExpire(alerter);
+      EXPECT_TRUE(alerter.Expired());
+   }
+}
+
+TEST_F(AlarmClockTest, DefaultWaitPolicyIsSleeping) {
+   AlarmClock<seconds> alerter(1000);
+   EXPECT_EQ(AlarmWaitPolicy::kSleep, alerter.WaitPolicy().mode);
+   EXPECT_EQ(-1, alerter.WaitPolicy().cpu);
+}
+
+TEST_F(AlarmClockTest, HybridPolicyExpiresAtDeadline) {
+   AlarmClock<milliseconds> alerter(1000, AlarmWaitPolicy::Hybrid(microseconds(500)));
+   EXPECT_EQ(AlarmWaitPolicy::kHybrid, alerter.WaitPolicy().mode);
+   for (int i = 0; i < 5; ++i) {
+      auto deadline = std::chrono::steady_clock::now() + milliseconds(5);
+      alerter.ArmAt(deadline);
+      EXPECT_FALSE(alerter.Expired());
+      while (!alerter.Expired()) {
+         std::this_thread::sleep_for(microseconds(10));
+      }
+      EXPECT_TRUE(std::chrono::steady_clock::now() >= deadline);
+   }
+}
+
+TEST_F(AlarmClockTest, SpinPolicyIsInterruptedByReset) {
+   AlarmClock<milliseconds> alerter(1000, AlarmWaitPolicy::Spinning());
+   std::this_thread::sleep_for(milliseconds(2));
+   EXPECT_FALSE(alerter.Expired());
+   StopWatch sw;
+   alerter.Reset(5);
+   while (!alerter.Expired()) {
+      std::this_thread::sleep_for(microseconds(10));
+   }
+   EXPECT_GE(sw.ElapsedUs(), static_cast<uint64_t>(ConvertToMicroSeconds(milliseconds(5))));
+}
+
+TEST_F(AlarmClockTest, PinnedAlarmThreadStillExpires) {
+   AlarmClock<milliseconds> alerter(2, AlarmWaitPolicy::Hybrid(microseconds(100), 0));
+   EXPECT_EQ(0, alerter.WaitPolicy().cpu);
+   while (!alerter.Expired()) {
+      std::this_thread::sleep_for(microseconds(10));
+   }
+   EXPECT_TRUE(alerter.Expired());
+}
+
+TEST_F(AlarmClockTest, VirtualClock_ExpiresWhenAdvanced) {
+   AlarmClock<seconds, VirtualClock> alerter(1000);
+   std::this_thread::sleep_for(milliseconds(1));
+   EXPECT_FALSE(alerter.Expired());
+   VirtualClock::Advance(seconds(999));
+   std::this_thread::sleep_for(milliseconds(1));
+   EXPECT_FALSE(alerter.Expired());
+   EXPECT_EQ(ConvertToMicroSeconds(seconds(1)), alerter.Remaining().count());
+
+   VirtualClock::Advance(seconds(1));
+   WaitForAlarmClockToExpire(alerter);
+   EXPECT_EQ(0, alerter.Remaining().count());
+}
+
+TEST_F(AlarmClockTest, VirtualClock_ResetAndArmAt) {
+   AlarmClock<seconds, VirtualClock> alerter(10);
+   VirtualClock::Advance(seconds(10));
+   WaitForAlarmClockToExpire(alerter);
+
+   alerter.Reset(60);
+   EXPECT_FALSE(alerter.Expired());
+   EXPECT_EQ(ConvertToMicroSeconds(seconds(60)), alerter.SleepTimeUs());
+   VirtualClock::Advance(seconds(60));
+   WaitForAlarmClockToExpire(alerter);
+
+   auto deadline = VirtualClock::now() + std::chrono::hours(24);
+   alerter.ArmAt(deadline);
+   EXPECT_FALSE(alerter.Expired());
+   VirtualClock::AdvanceTo(deadline);
+   WaitForAlarmClockToExpire(alerter);
+   EXPECT_TRUE(VirtualClock::now() >= deadline);
+}
+
+TEST_F(AlarmClockTest, ExpireAtUsStillWaitsRelativeToNow) {
+   LegacyAlarm alarm(10000);
+   StopWatch sw;
+   EXPECT_TRUE(alarm.ExpireAtUs(2000));
+   EXPECT_GE(sw.ElapsedUs(), 2000u);
+   EXPECT_FALSE(alarm.Expired());
+}
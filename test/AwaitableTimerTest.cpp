@@ -0,0 +1,117 @@
+/*
+ * Compiled as C++20, see CMakeLists.txt
+ */
+#include "TimerLoopTest.h"
+#include "AwaitableTimer.h"
+#include "StopWatch.h"
+#include <coroutine>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+   typedef std::chrono::milliseconds milliseconds;
+
+   // Minimal eagerly started coroutine that is never awaited
+   struct Detached {
+      struct promise_type {
+         Detached get_return_object() { return {}; }
+         std::suspend_never initial_suspend() noexcept { return {}; }
+         std::suspend_never final_suspend() noexcept { return {}; }
+         void return_void() {}
+         void unhandled_exception() { std::terminate(); }
+      };
+   };
+
+   Detached SleepTwice(TimerLoop& loop, std::vector<bool>& results) {
+      results.push_back(co_await SleepFor(loop, milliseconds(2)));
+      results.push_back(co_await SleepUntil(loop, TimerLoop::clock::now() + milliseconds(2)));
+   }
+
+   Detached WaitOnTimer(AwaitableTimer<milliseconds>& timer, unsigned int ms, std::vector<bool>& results) {
+      results.push_back(co_await timer.SleepFor(ms));
+   }
+
+   Detached WaitOrRejected(AwaitableTimer<milliseconds>& timer, unsigned int ms, std::vector<bool>& results, bool& rejected) {
+      try {
+         results.push_back(co_await timer.SleepFor(ms));
+      } catch (const std::logic_error&) {
+         rejected = true;
+      }
+   }
+
+   Detached CancelAfter(TimerLoop& loop, AwaitableTimer<milliseconds>& timer) {
+      co_await SleepFor(loop, milliseconds(1));
+      timer.Cancel();
+   }
+}
+
+TEST_F(TimerLoopTest, CoroutineSleeps) {
+   TimerLoop loop;
+   std::vector<bool> results;
+   StopWatch sw;
+   SleepTwice(loop, results);
+   EXPECT_TRUE(results.empty());
+   loop.Run();
+   EXPECT_GE(sw.ElapsedUs(), 4000u);
+   ASSERT_EQ(2u, results.size());
+   EXPECT_TRUE(results[0]);
+   EXPECT_TRUE(results[1]);
+}
+
+TEST_F(TimerLoopTest, CoroutineDueDeadlineDoesNotSuspend) {
+   TimerLoop loop;
+   std::vector<bool> results;
+   AwaitableTimer<milliseconds> timer(loop);
+   WaitOnTimer(timer, 0, results);
+   ASSERT_EQ(1u, results.size());
+   EXPECT_TRUE(results[0]);
+   EXPECT_EQ(0u, loop.PendingCount());
+}
+
+TEST_F(TimerLoopTest, CoroutineCancelled) {
+   TimerLoop loop;
+   std::vector<bool> results;
+   AwaitableTimer<milliseconds> timer(loop);
+   WaitOnTimer(timer, 100000, results);
+   CancelAfter(loop, timer);
+   StopWatch sw;
+   loop.Run();
+   EXPECT_LT(sw.ElapsedMs(), 1000u);
+   ASSERT_EQ(1u, results.size());
+   EXPECT_FALSE(results[0]);
+
+   // the timer is reusable after a cancel
+   WaitOnTimer(timer, 1, results);
+   loop.Run();
+   ASSERT_EQ(2u, results.size());
+   EXPECT_TRUE(results[1]);
+}
+
+TEST_F(TimerLoopTest, ManyCoroutinesShareOneLoop) {
+   TimerLoop loop;
+   const size_t kTimers = 200;
+   loop.Reserve(kTimers);
+   std::vector<bool> results;
+   results.reserve(2 * kTimers);
+   for (size_t i = 0; i < kTimers; ++i) {
+      SleepTwice(loop, results);
+   }
+   loop.Run();
+   EXPECT_EQ(2 * kTimers, results.size());
+}
+
+TEST_F(TimerLoopTest, CoroutineSecondAwaiterIsRejected) {
+   TimerLoop loop;
+   std::vector<bool> results;
+   AwaitableTimer<milliseconds> timer(loop);
+   bool firstRejected = false;
+   bool secondRejected = false;
+   WaitOrRejected(timer, 2, results, firstRejected);
+   WaitOrRejected(timer, 2, results, secondRejected);
+   EXPECT_FALSE(firstRejected);
+   EXPECT_TRUE(secondRejected);
+   loop.Run();
+   ASSERT_EQ(1u, results.size()); // the first coroutine is still resumed
+   EXPECT_TRUE(results[0]);
+}
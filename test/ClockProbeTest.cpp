@@ -0,0 +1,112 @@
+#include "ClockProbeTest.h"
+#include "ClockProbe.h"
+#include <string>
+#include <vector>
+
+namespace {
+   ClockCharacteristics Qualified(const std::string& name, double readCostNs) {
+      ClockCharacteristics clock;
+      clock.name = name;
+      clock.available = true;
+      clock.steady = true;
+      clock.readCostNs = readCostNs;
+      clock.resolutionNs = 1;
+      clock.backwardSteps = 0;
+      clock.crossCoreChecked = true;
+      clock.crossCoreBackwardSteps = 0;
+      clock.crossCoreMaxSkewNs = 0;
+      return clock;
+   }
+}
+
+TEST_F(ClockProbeTest, ProbeSteadyClock) {
+   const ClockCharacteristics clock = ClockProbe::Probe(ClockProbe::kSteady, 1000);
+   EXPECT_EQ("steady_clock", clock.name);
+   EXPECT_TRUE(clock.available);
+   EXPECT_TRUE(clock.steady);
+   EXPECT_GT(clock.readCostNs, 0);
+   EXPECT_GT(clock.resolutionNs, 0);
+   EXPECT_EQ(0u, clock.backwardSteps);
+   EXPECT_EQ(0u, clock.crossCoreBackwardSteps);
+   EXPECT_EQ(0u, clock.AsString().find("steady_clock: Read: ")) << clock.AsString();
+}
+
+TEST_F(ClockProbeTest, ProbeAll) {
+   const std::vector<ClockCharacteristics> probed = ClockProbe::ProbeAll(1000);
+   ASSERT_EQ(static_cast<size_t>(ClockProbe::kSourceCount), probed.size());
+   EXPECT_EQ("steady_clock", probed[ClockProbe::kSteady].name);
+   EXPECT_EQ("high_resolution_clock", probed[ClockProbe::kHighResolution].name);
+   EXPECT_EQ("tsc", probed[ClockProbe::kTsc].name);
+   EXPECT_EQ(std::chrono::high_resolution_clock::is_steady, probed[ClockProbe::kHighResolution].steady);
+
+   // whatever this host looks like, the selection is a usable steady source
+   const ClockProbe::Source selected = ClockProbe::Select(probed);
+   EXPECT_TRUE(probed[selected].available);
+   EXPECT_TRUE(probed[selected].steady);
+}
+
+TEST_F(ClockProbeTest, SelectCheapestQualified) {
+   std::vector<ClockCharacteristics> probed;
+   probed.push_back(Qualified("steady_clock", 25));
+   probed.push_back(Qualified("high_resolution_clock", 20));
+   probed.push_back(Qualified("tsc", 8));
+   EXPECT_EQ(ClockProbe::kTsc, ClockProbe::Select(probed));
+
+   probed[ClockProbe::kTsc].crossCoreBackwardSteps = 1;
+   EXPECT_EQ(ClockProbe::kHighResolution, ClockProbe::Select(probed));
+
+   probed[ClockProbe::kHighResolution].steady = false;
+   EXPECT_EQ(ClockProbe::kSteady, ClockProbe::Select(probed));
+}
+
+TEST_F(ClockProbeTest, SelectRejectsCoarseAndBackwards) {
+   std::vector<ClockCharacteristics> probed;
+   probed.push_back(Qualified("steady_clock", 500)); // syscall fallback
+   probed.push_back(Qualified("high_resolution_clock", 20));
+   probed.push_back(Qualified("tsc", 8));
+   probed[ClockProbe::kHighResolution].resolutionNs = 4 * 1000 * 1000;
+   probed[ClockProbe::kTsc].backwardSteps = 3;
+   EXPECT_EQ(ClockProbe::kSteady, ClockProbe::Select(probed));
+
+   probed[ClockProbe::kTsc].backwardSteps = 0;
+   probed[ClockProbe::kTsc].available = false;
+   EXPECT_EQ(ClockProbe::kSteady, ClockProbe::Select(probed));
+
+   // steady_clock is the fallback even if it does not qualify itself
+   probed[ClockProbe::kSteady].resolutionNs = 0;
+   EXPECT_EQ(ClockProbe::kSteady, ClockProbe::Select(probed));
+}
+
+TEST_F(ClockProbeTest, AutoClock) {
+   AutoClock::Initialize();
+   const std::string report = AutoClock::Report();
+   EXPECT_EQ(0u, report.find(std::string("Clock source: ") + ClockProbe::Name(AutoClock::Source()))) << report;
+   EXPECT_NE(std::string::npos, report.find("\n\tsteady_clock: Read: ")) << report;
+
+   const AutoClock::time_point first = AutoClock::now();
+   const AutoClock::time_point second = AutoClock::now();
+   EXPECT_LE(first, second);
+
+   AutoStopWatch stopWatch;
+   EXPECT_GE(stopWatch.ElapsedNs(), 0u);
+}
+
+TEST_F(ClockProbeTest, AutoClockUse) {
+   const ClockProbe::Source before = AutoClock::Source();
+   EXPECT_TRUE(AutoClock::Use(ClockProbe::kSteady));
+   EXPECT_EQ(ClockProbe::kSteady, AutoClock::Source());
+   EXPECT_NE(std::string::npos, AutoClock::Report().find("Clock source: steady_clock (set by Use")) << AutoClock::Report();
+   const int64_t steady = ClockProbe::Read(ClockProbe::kSteady);
+   EXPECT_GE(AutoClock::now().time_since_epoch().count(), steady);
+   AutoClock::Use(before);
+}
+
+TEST_F(ClockProbeTest, AutoClockOnlyUsesSteadySources) {
+   const ClockProbe::Source before = AutoClock::Source();
+   EXPECT_EQ(std::chrono::high_resolution_clock::is_steady, AutoClock::Use(ClockProbe::kHighResolution));
+   const ClockCharacteristics tsc = ClockProbe::Probe(ClockProbe::kTsc, 1);
+   EXPECT_EQ(tsc.available && tsc.steady, AutoClock::Use(ClockProbe::kTsc));
+   EXPECT_FALSE(AutoClock::Use(ClockProbe::kSourceCount));
+   AutoClock::Use(before);
+   EXPECT_EQ(before, AutoClock::Source());
+}
@@ -0,0 +1,22 @@
+/*
+ * File:   ClockProbeTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class ClockProbeTest : public ::testing::Test {
+public:
+
+   ClockProbeTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
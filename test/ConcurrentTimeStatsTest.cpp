@@ -0,0 +1,90 @@
+#include "ConcurrentTimeStatsTest.h"
+#include "ConcurrentTimeStats.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+   const long long kNanoSecMinFake = 100;
+   const long long kNanoSecMaxFake = 300;
+   const long long kAverage = 200;
+}
+
+TEST_F(ConcurrentTimeStatsTest, SnapshotDoesNotReset) {
+   ConcurrentTimeStats stats;
+   auto empty = stats.Snapshot();
+   EXPECT_EQ(0, empty.count);
+   EXPECT_EQ(std::numeric_limits<long long>::max(), empty.minTime);
+
+   stats.Save(kNanoSecMinFake);
+   stats.Save(kNanoSecMaxFake);
+   auto first = stats.Snapshot();
+   auto second = stats.Snapshot();
+   EXPECT_EQ(first.AsMetrics(), second.AsMetrics());
+   TimeStats::Metrics metrics = second.AsMetrics();
+   EXPECT_EQ(kNanoSecMinFake, std::get<TimeStats::Index::MinTime>(metrics));
+   EXPECT_EQ(kNanoSecMaxFake, std::get<TimeStats::Index::MaxTime>(metrics));
+   EXPECT_EQ(2, std::get<TimeStats::Index::Count>(metrics));
+   EXPECT_EQ(kAverage, std::get<TimeStats::Index::Average>(metrics));
+}
+
+TEST_F(ConcurrentTimeStatsTest, Delta) {
+   ConcurrentTimeStats stats;
+   stats.Save(1000);
+   auto earlier = stats.Snapshot();
+   std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   stats.Save(100);
+   stats.Save(300);
+   auto delta = stats.Snapshot().Delta(earlier);
+   EXPECT_EQ(2, delta.count);
+   EXPECT_EQ(400, delta.totalTime);
+   EXPECT_EQ(kAverage, delta.Average());
+   EXPECT_GE(delta.interval, std::chrono::milliseconds(10));
+   EXPECT_GT(delta.RatePerSecond(), 0);
+   EXPECT_LE(delta.RatePerSecond(), 200);
+}
+
+TEST_F(ConcurrentTimeStatsTest, SnapshotsAreNeverTorn) {
+   ConcurrentTimeStats stats;
+   std::atomic<bool> done{false};
+   std::thread writer([&] {
+      // with a constant value every consistent snapshot has total == 7 * count
+      for (int i = 0; i < 2000000; ++i) {
+         stats.Save(7);
+      }
+      done.store(true);
+   });
+
+   // counted and checked after the join, an ASSERT here would leave the
+   // writer joinable
+   long long snapshots = 0;
+   long long torn = 0;
+   long long backwards = 0;
+   long long previousCount = 0;
+   while (!done.load()) {
+      auto snapshot = stats.Snapshot();
+      torn += (7 * snapshot.count != snapshot.totalTime);
+      backwards += (snapshot.count < previousCount);
+      previousCount = snapshot.count;
+      ++snapshots;
+   }
+   writer.join();
+   EXPECT_EQ(0, torn);
+   EXPECT_EQ(0, backwards);
+   EXPECT_EQ(2000000, stats.Snapshot().count);
+   EXPECT_GT(snapshots, 0);
+}
+
+TEST_F(ConcurrentTimeStatsTest, CacheLineAlignedOnTheHeap) {
+   std::vector<std::unique_ptr<ConcurrentTimeStats>> heap;
+   for (int i = 0; i < 8; ++i) {
+      heap.emplace_back(new ConcurrentTimeStats);
+      EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(heap.back().get()) % 64);
+   }
+   std::unique_ptr<ConcurrentTimeStats[]> array(new ConcurrentTimeStats[3]);
+   EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&array[1]) % 64);
+}
@@ -0,0 +1,22 @@
+/*
+ * File:   ConcurrentTimeStatsTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class ConcurrentTimeStatsTest : public ::testing::Test {
+public:
+
+   ConcurrentTimeStatsTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
@@ -0,0 +1,189 @@
+#include "LabelledTimeStatsTest.h"
+#include "LabelledTimeStats.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+   const LabelledTimeStats::LabelMetrics* FindRow(const std::vector<LabelledTimeStats::LabelMetrics>& rows,
+                                                  const std::string& label) {
+      for (const auto& row : rows) {
+         if (row.label == label) {
+            return &row;
+         }
+      }
+      return nullptr;
+   }
+
+   long long CountOf(const LabelledTimeStats::LabelMetrics* row) {
+      return row == nullptr ? 0 : std::get<TimeStats::Index::Count>(row->metrics);
+   }
+}
+
+TEST_F(LabelledTimeStatsTest, PerLabelMetrics) {
+   LabelledTimeStats stats(10);
+   const LabelledTimeStats::Label syslog("syslog");
+   stats.Save(syslog, 100);
+   stats.Save(syslog, 300);
+   stats.Save(std::string("syslog"), 200);
+   stats.Save(std::string("netflow"), 50);
+   EXPECT_EQ(2u, stats.Size());
+
+   const auto rows = stats.FlushAsMetrics();
+   ASSERT_EQ(2u, rows.size());
+   EXPECT_EQ("netflow", rows[0].label); // sorted on label
+   EXPECT_EQ("syslog", rows[1].label);
+   EXPECT_EQ(100, std::get<TimeStats::Index::MinTime>(rows[1].metrics));
+   EXPECT_EQ(300, std::get<TimeStats::Index::MaxTime>(rows[1].metrics));
+   EXPECT_EQ(3, std::get<TimeStats::Index::Count>(rows[1].metrics));
+   EXPECT_EQ(600, std::get<TimeStats::Index::TotalTime>(rows[1].metrics));
+   EXPECT_EQ(200, std::get<TimeStats::Index::Average>(rows[1].metrics));
+   EXPECT_EQ(3u, rows[1].weight);
+   EXPECT_EQ(0u, rows[1].error);
+}
+
+TEST_F(LabelledTimeStatsTest, PrecomputedHash) {
+   LabelledTimeStats stats(10);
+   const std::string label = "apache";
+   EXPECT_EQ(LabelledTimeStats::Hash(label.data(), label.size()), LabelledTimeStats::Label(label).hash);
+   stats.Save(LabelledTimeStats::Label(label).hash, label.data(), label.size(), 10);
+   stats.Save(label, 20);
+   EXPECT_EQ(1u, stats.Size());
+
+   // two labels with the same hash are still kept apart
+   stats.Save(LabelledTimeStats::Hash("apache", 6), "iis", 3, 30);
+   EXPECT_EQ(2u, stats.Size());
+   const auto rows = stats.FlushAsMetrics();
+   EXPECT_EQ(2, CountOf(FindRow(rows, "apache")));
+   EXPECT_EQ(1, CountOf(FindRow(rows, "iis")));
+}
+
+TEST_F(LabelledTimeStatsTest, FlushKeepsLabels) {
+   LabelledTimeStats stats(10);
+   stats.Save(std::string("a"), 1);
+   stats.Save(std::string("b"), 1);
+   EXPECT_EQ(2u, stats.FlushAsMetrics().size());
+   EXPECT_EQ(2u, stats.Size());
+
+   stats.Save(std::string("a"), 1);
+   const auto rows = stats.FlushAsMetrics();
+   ASSERT_EQ(1u, rows.size());
+   EXPECT_EQ("a", rows[0].label);
+   EXPECT_EQ(2u, rows[0].weight); // the weight survives the flush
+   EXPECT_TRUE(stats.FlushAsMetrics().empty());
+   EXPECT_EQ("Count: 0, no measurements available", stats.FlushAsString());
+}
+
+TEST_F(LabelledTimeStatsTest, HardCapEvictsIntoOther) {
+   LabelledTimeStats stats(4, 1);
+   for (int i = 0; i < 100; ++i) {
+      stats.Save(std::string("label") + std::to_string(i), 10);
+   }
+   EXPECT_EQ(4u, stats.Size());
+   EXPECT_EQ(96u, stats.Evictions());
+
+   const auto rows = stats.FlushAsMetrics();
+   ASSERT_EQ(5u, rows.size());
+   EXPECT_EQ(LabelledTimeStats::kOtherLabel, rows.back().label);
+   EXPECT_EQ(96, CountOf(&rows.back()));
+   long long total = 0;
+   for (const auto& row : rows) {
+      total += CountOf(&row);
+   }
+   EXPECT_EQ(100, total); // nothing is lost
+}
+
+TEST_F(LabelledTimeStatsTest, HeavyHittersSurvive) {
+   LabelledTimeStats stats(8, 1);
+   for (int round = 0; round < 50; ++round) {
+      for (int i = 0; i < 10; ++i) {
+         stats.Save(std::string("heavy1"), 1);
+         stats.Save(std::string("heavy2"), 1);
+         stats.Save(std::string("heavy3"), 1);
+      }
+      for (int i = 0; i < 20; ++i) {
+         stats.Save(std::string("tail") + std::to_string(round * 20 + i), 1);
+      }
+   }
+   EXPECT_EQ(8u, stats.Size());
+
+   // more frequent than 1 / maxLabels, so never evicted
+   const auto rows = stats.FlushAsMetrics();
+   EXPECT_EQ(500, CountOf(FindRow(rows, "heavy1")));
+   EXPECT_EQ(500, CountOf(FindRow(rows, "heavy2")));
+   EXPECT_EQ(500, CountOf(FindRow(rows, "heavy3")));
+   EXPECT_GT(CountOf(FindRow(rows, LabelledTimeStats::kOtherLabel)), 900);
+}
+
+TEST_F(LabelledTimeStatsTest, HeavyHitterIsAdmittedInEveryShard) {
+   // room for 4 labels in 64 shards, most new labels land in an empty shard
+   LabelledTimeStats stats(4, 64);
+   for (int i = 0; i < 100; ++i) {
+      stats.Save(std::string("tail") + std::to_string(i), 1);
+   }
+   EXPECT_EQ(4u, stats.Size());
+   // whatever shard they hash to, frequent labels get in once the cap is reached
+   for (const std::string heavy : {"heavy1", "heavy2", "heavy3", "heavy4", "heavy5", "heavy6"}) {
+      stats.FlushAsMetrics();
+      for (int i = 0; i < 50; ++i) {
+         stats.Save(heavy, 1);
+      }
+      EXPECT_EQ(50, CountOf(FindRow(stats.FlushAsMetrics(), heavy))) << heavy;
+   }
+   EXPECT_EQ(4u, stats.Size());
+}
+
+TEST_F(LabelledTimeStatsTest, EvictsTheLightestLabel) {
+   LabelledTimeStats stats(3, 1);
+   for (int i = 0; i < 5; ++i) {
+      stats.Save(std::string("five"), 1);
+   }
+   stats.Save(std::string("one"), 1);
+   for (int i = 0; i < 3; ++i) {
+      stats.Save(std::string("three"), 1);
+   }
+   stats.Save(std::string("new"), 1); // evicts "one" and inherits its weight
+   const auto rows = stats.FlushAsMetrics();
+   EXPECT_EQ(nullptr, FindRow(rows, "one"));
+   ASSERT_NE(nullptr, FindRow(rows, "new"));
+   EXPECT_EQ(2u, FindRow(rows, "new")->weight);
+   EXPECT_EQ(1u, FindRow(rows, "new")->error);
+   EXPECT_EQ(1, CountOf(FindRow(rows, LabelledTimeStats::kOtherLabel)));
+   EXPECT_EQ(5, CountOf(FindRow(rows, "five")));
+   EXPECT_EQ(3, CountOf(FindRow(rows, "three")));
+}
+
+TEST_F(LabelledTimeStatsTest, ConcurrentSaves) {
+   LabelledTimeStats stats(64);
+   std::vector<LabelledTimeStats::Label> labels;
+   for (int i = 0; i < 32; ++i) {
+      labels.emplace_back("parser" + std::to_string(i));
+   }
+   std::vector<std::thread> threads;
+   for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&stats, &labels] {
+         for (int i = 0; i < 10000; ++i) {
+            stats.Save(labels[i % labels.size()], i);
+         }
+      });
+   }
+   for (auto& thread : threads) {
+      thread.join();
+   }
+   const auto rows = stats.FlushAsMetrics();
+   ASSERT_EQ(32u, rows.size());
+   long long total = 0;
+   for (const auto& row : rows) {
+      total += CountOf(&row);
+   }
+   EXPECT_EQ(40000, total);
+   EXPECT_EQ(0u, stats.Evictions());
+}
+
+TEST_F(LabelledTimeStatsTest, FlushAsString) {
+   LabelledTimeStats stats(1, 1);
+   stats.Save(std::string("a"), 100);
+   stats.Save(std::string("b"), 300);
+   EXPECT_EQ("b: Count: 1, Min time: 300 ns, Max time: 300 ns, Average: 300 ns"
+             "\nother: Count: 1, Min time: 100 ns, Max time: 100 ns, Average: 100 ns", stats.FlushAsString());
+}
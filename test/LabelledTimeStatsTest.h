@@ -0,0 +1,22 @@
+/*
+ * File:   LabelledTimeStatsTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class LabelledTimeStatsTest : public ::testing::Test {
+public:
+
+   LabelledTimeStatsTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
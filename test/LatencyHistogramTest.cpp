@@ -0,0 +1,33 @@
+#include "LatencyHistogramTest.h"
+#include "LatencyHistogram.h"
+#include <limits>
+
+TEST_F(LatencyHistogramTest, BucketsRoundTrip) {
+   for (long long value : {0LL, 1LL, 63LL, 64LL, 65LL, 1000LL, 123456789LL, (1LL << 62) + 5}) {
+      size_t index = LatencyHistogram::BucketIndex(value);
+      EXPECT_LE(LatencyHistogram::BucketLowerBound(index), value);
+      EXPECT_GE(LatencyHistogram::BucketUpperBound(index), value);
+      // relative precision of a bucket is about 3 %
+      EXPECT_LE(LatencyHistogram::BucketUpperBound(index) - LatencyHistogram::BucketLowerBound(index), value / 32 + 1);
+   }
+   EXPECT_EQ(LatencyHistogram::kBucketCount - 1, LatencyHistogram::BucketIndex(std::numeric_limits<long long>::max()));
+   EXPECT_EQ(0u, LatencyHistogram::BucketIndex(-5));
+}
+
+TEST_F(LatencyHistogramTest, Percentiles) {
+   LatencyHistogram histogram;
+   EXPECT_EQ(0, histogram.Percentile(99));
+   for (long long value = 1; value <= 1000; ++value) {
+      histogram.Record(value * 1000);
+   }
+   EXPECT_EQ(1000u, histogram.Count());
+   EXPECT_NEAR(500000, histogram.Percentile(50), 500000 / 32);
+   EXPECT_NEAR(990000, histogram.Percentile(99), 990000 / 32);
+   EXPECT_NEAR(1000000, histogram.Percentile(100), 1000000 / 32);
+
+   LatencyHistogram other;
+   other.Record(5000000000LL);
+   histogram.Merge(other);
+   EXPECT_EQ(1001u, histogram.Count());
+   EXPECT_NEAR(5000000000LL, histogram.Percentile(100), 5000000000LL / 32);
+}
@@ -0,0 +1,22 @@
+/*
+ * File:   LatencyHistogramTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class LatencyHistogramTest : public ::testing::Test {
+public:
+
+   LatencyHistogramTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
@@ -0,0 +1,59 @@
+#include "LoadGeneratorTest.h"
+#include "LoadGenerator.h"
+#include "TscClock.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+   typedef std::chrono::milliseconds milliseconds;
+}
+
+TEST_F(LoadGeneratorTest, IssuesAtTargetRate) {
+   LoadGenerator<>::Config config;
+   config.ratePerSecond = 2000;
+   config.duration = milliseconds(100);
+   config.issuers = 2;
+   std::atomic<int> calls{0};
+   auto result = LoadGenerator<>::Run(config, [&] { ++calls; });
+   EXPECT_EQ(200, calls.load());
+   EXPECT_EQ(200, result.issued);
+   EXPECT_EQ(200u, result.latency.Histogram().Count());
+   EXPECT_GT(result.achievedRate, 1000);
+   EXPECT_NE(std::string::npos, result.FlushAsString().find("Issued: 200"));
+}
+
+TEST_F(LoadGeneratorTest, StallIsNotOmitted) {
+   // One call stalls for 20 ms at 1000 calls/s: every call scheduled during
+   // the stall is late, which a closed loop would never see.
+   LoadGenerator<TscClock>::Config config;
+   config.ratePerSecond = 1000;
+   config.duration = milliseconds(100);
+   std::atomic<int> calls{0};
+   auto result = LoadGenerator<TscClock>::Run(config, [&] {
+      if (++calls == 10) {
+         std::this_thread::sleep_for(milliseconds(20));
+      }
+   });
+   const long long kStallNs = 20000000;
+   EXPECT_GE(result.service.Percentile(100), kStallNs - kStallNs / 32);
+   EXPECT_LT(result.service.Percentile(90), kStallNs / 2);
+   // about 20 calls were queued behind the stall, that is above 10 % of them
+   EXPECT_GE(result.latency.Percentile(90), kStallNs / 4);
+}
+
+TEST_F(LoadGeneratorTest, SweepStopsAtSlo) {
+   LoadGenerator<>::SweepConfig sweep;
+   sweep.startRate = 100;
+   sweep.maxRate = 100000;
+   sweep.rateFactor = 4;
+   // milliseconds, so that scheduling noise on a loaded host does not matter
+   sweep.sloNs = 30000000;
+   sweep.stepDuration = milliseconds(100);
+   // the service can handle about 1000 calls/s
+   auto outcome = LoadGenerator<>::Sweep(sweep, [] { std::this_thread::sleep_for(milliseconds(1)); });
+   ASSERT_FALSE(outcome.steps.empty());
+   EXPECT_FALSE(outcome.steps.back().withinSlo);
+   EXPECT_GE(outcome.maxRateWithinSlo, 100);
+   EXPECT_LT(outcome.maxRateWithinSlo, 1600);
+}
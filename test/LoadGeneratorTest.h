@@ -0,0 +1,22 @@
+/*
+ * File:   LoadGeneratorTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class LoadGeneratorTest : public ::testing::Test {
+public:
+
+   LoadGeneratorTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
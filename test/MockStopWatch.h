@@ -1,5 +1,6 @@
 #pragma once
 
+#include <ctime>
 #include "StopWatch.h"
 
 class MockStopWatch : public StopWatch {
@@ -9,7 +10,12 @@ public:
    };
 
    void SetTimeForwardSeconds(const std::time_t warp) {
-      mStart = clock::time_point(clock::now() + std::chrono::seconds(warp));
+      SetTimeForward(std::chrono::seconds(warp));
+   }
+
+   template<typename Rep, typename Period>
+   void SetTimeForward(std::chrono::duration<Rep, Period> warp) {
+      mStart = clock::time_point(clock::now() + std::chrono::duration_cast<clock::duration>(warp));
    }
 };
 
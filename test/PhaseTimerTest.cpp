@@ -0,0 +1,83 @@
+#include "PhaseTimerTest.h"
+#include "PhaseTimer.h"
+#include "VirtualClock.h"
+#include <chrono>
+#include <limits>
+#include <string>
+
+namespace {
+   typedef std::chrono::microseconds microseconds;
+
+   struct Decode { static const char* Name() { return "decode"; } };
+   struct Parse { static const char* Name() { return "parse"; } };
+   struct Write { static const char* Name() { return "write"; } };
+
+   typedef BasicPhaseTimer<VirtualClock, Decode, Parse, Write> PipelineTimer;
+
+   void RunEvent(PipelineTimer& timer, int decodeUs, int parseUs, int writeUs) {
+      timer.Begin();
+      VirtualClock::Advance(microseconds(decodeUs));
+      timer.Mark<Decode>();
+      VirtualClock::Advance(microseconds(parseUs));
+      timer.Mark<Parse>();
+      VirtualClock::Advance(microseconds(writeUs));
+      timer.Mark<Write>();
+      timer.Finish();
+   }
+}
+
+TEST_F(PhaseTimerTest, PhaseIndexAndNames) {
+   EXPECT_EQ(3u, PipelineTimer::kPhases);
+   EXPECT_EQ(0u, PipelineTimer::IndexOf<Decode>());
+   EXPECT_EQ(2u, PipelineTimer::IndexOf<Write>());
+   EXPECT_EQ(std::string("parse"), PipelineTimer::Name(1));
+}
+
+TEST_F(PhaseTimerTest, DeltasGoToTheirPhase) {
+   PipelineTimer timer;
+   RunEvent(timer, 10, 20, 70);
+   RunEvent(timer, 30, 20, 70);
+
+   auto decode = timer.PhaseMetrics(PipelineTimer::IndexOf<Decode>());
+   EXPECT_EQ(10000, std::get<TimeStats::Index::MinTime>(decode));
+   EXPECT_EQ(30000, std::get<TimeStats::Index::MaxTime>(decode));
+   EXPECT_EQ(2, std::get<TimeStats::Index::Count>(decode));
+   EXPECT_EQ(20000, std::get<TimeStats::Index::Average>(decode));
+
+   auto endToEnd = timer.EndToEndMetrics();
+   EXPECT_EQ(100000, std::get<TimeStats::Index::MinTime>(endToEnd));
+   EXPECT_EQ(120000, std::get<TimeStats::Index::MaxTime>(endToEnd));
+   EXPECT_EQ(220000, std::get<TimeStats::Index::TotalTime>(endToEnd));
+}
+
+TEST_F(PhaseTimerTest, SharesOfEndToEnd) {
+   PipelineTimer timer;
+   RunEvent(timer, 10, 20, 70);
+   EXPECT_DOUBLE_EQ(0.1, timer.Share<Decode>());
+   EXPECT_DOUBLE_EQ(0.2, timer.Share<Parse>());
+   EXPECT_DOUBLE_EQ(0.7, timer.Share<Write>());
+}
+
+TEST_F(PhaseTimerTest, SkippedPhaseIsNotCounted) {
+   PipelineTimer timer;
+   timer.Begin();
+   VirtualClock::Advance(microseconds(5));
+   timer.Mark<Decode>();
+   // dropped after decoding, parse and write never run
+   timer.Finish();
+   EXPECT_EQ(1, std::get<TimeStats::Index::Count>(timer.PhaseMetrics(0)));
+   EXPECT_EQ(0, std::get<TimeStats::Index::Count>(timer.PhaseMetrics(1)));
+   EXPECT_EQ(5000, std::get<TimeStats::Index::TotalTime>(timer.EndToEndMetrics()));
+}
+
+TEST_F(PhaseTimerTest, FlushAsString) {
+   PipelineTimer timer;
+   EXPECT_EQ("Count: 0, no measurements available", timer.FlushAsString());
+   RunEvent(timer, 10, 20, 70);
+   std::string expected = "End to end: Count: 1, Average: 100000 ns, Max time: 100000 ns";
+   expected += "\n\tdecode: Count: 1, Average: 10000 ns, Max time: 10000 ns, Share: 10.0 %";
+   expected += "\n\tparse: Count: 1, Average: 20000 ns, Max time: 20000 ns, Share: 20.0 %";
+   expected += "\n\twrite: Count: 1, Average: 70000 ns, Max time: 70000 ns, Share: 70.0 %";
+   EXPECT_EQ(expected, timer.FlushAsString());
+   EXPECT_EQ(std::numeric_limits<long long>::max(), std::get<TimeStats::Index::MinTime>(timer.EndToEndMetrics()));
+}
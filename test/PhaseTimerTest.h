@@ -0,0 +1,22 @@
+/*
+ * File:   PhaseTimerTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class PhaseTimerTest : public ::testing::Test {
+public:
+
+   PhaseTimerTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
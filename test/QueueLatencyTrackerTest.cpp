@@ -0,0 +1,156 @@
+#include "QueueLatencyTrackerTest.h"
+#include "QueueLatencyTracker.h"
+#include "VirtualClock.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+   typedef std::chrono::microseconds microseconds;
+   typedef BasicQueueLatencyTracker<VirtualClock> VirtualTracker;
+
+   struct Event {
+      QueueStamp stamp;
+      int payload;
+   };
+}
+
+TEST_F(QueueLatencyTrackerTest, SojournTime) {
+   VirtualTracker tracker;
+   Event first, second;
+   tracker.Stamp(first.stamp);
+   VirtualClock::Advance(microseconds(10));
+   tracker.Stamp(second.stamp);
+   VirtualClock::Advance(microseconds(30));
+   EXPECT_EQ(40000, tracker.Close(first.stamp));
+   EXPECT_EQ(30000, tracker.Close(second.stamp));
+
+   auto snapshot = tracker.TakeSnapshot();
+   EXPECT_EQ(2, snapshot.count);
+   EXPECT_EQ(70000, snapshot.totalTime);
+   EXPECT_EQ(30000, snapshot.minTime);
+   EXPECT_EQ(40000, snapshot.maxTime);
+   EXPECT_EQ(35000, std::get<TimeStats::Index::Average>(snapshot.AsMetrics()));
+   EXPECT_TRUE(snapshot.depth.empty());
+}
+
+TEST_F(QueueLatencyTrackerTest, DepthBucketIndex) {
+   EXPECT_EQ(0u, VirtualTracker::DepthBucketIndex(0));
+   EXPECT_EQ(1u, VirtualTracker::DepthBucketIndex(1));
+   EXPECT_EQ(2u, VirtualTracker::DepthBucketIndex(2));
+   EXPECT_EQ(2u, VirtualTracker::DepthBucketIndex(3));
+   EXPECT_EQ(3u, VirtualTracker::DepthBucketIndex(4));
+   EXPECT_EQ(11u, VirtualTracker::DepthBucketIndex(1024));
+   EXPECT_EQ(VirtualTracker::kDepthBuckets - 1, VirtualTracker::DepthBucketIndex(UINT64_MAX));
+}
+
+TEST_F(QueueLatencyTrackerTest, WaitPerProducerDepth) {
+   VirtualTracker tracker(1);
+   // a message that found a short queue waits less than one behind a backlog
+   Event shortQueue, longQueue, unknown;
+   tracker.Stamp(shortQueue.stamp, 1);
+   VirtualClock::Advance(microseconds(5));
+   tracker.Close(shortQueue.stamp);
+   tracker.Stamp(longQueue.stamp, 100);
+   VirtualClock::Advance(microseconds(500));
+   tracker.Close(longQueue.stamp);
+   tracker.Stamp(unknown.stamp);
+   tracker.Close(unknown.stamp);
+
+   auto snapshot = tracker.TakeSnapshot();
+   ASSERT_EQ(2u, snapshot.depth.size());
+   EXPECT_EQ(1u, snapshot.depth[0].minDepth);
+   EXPECT_EQ(1u, snapshot.depth[0].maxDepth);
+   EXPECT_EQ(5000, snapshot.depth[0].AverageWaitNs());
+   EXPECT_EQ(64u, snapshot.depth[1].minDepth);
+   EXPECT_EQ(127u, snapshot.depth[1].maxDepth);
+   EXPECT_EQ(500000, snapshot.depth[1].AverageWaitNs());
+   EXPECT_EQ("Count: 3, Average wait: 168 us, Max wait: 500 us, Depth 1-1: 5 us, Depth 64-127: 500 us", snapshot.AsString());
+}
+
+TEST_F(QueueLatencyTrackerTest, TrackedDepthIsSampled) {
+   VirtualTracker tracker(2, true);
+   std::vector<Event> events(8);
+   for (auto& event : events) {
+      tracker.Stamp(event.stamp);
+   }
+   EXPECT_EQ(8u, tracker.Depth());
+   EXPECT_EQ(7u, events.back().stamp.depth);
+   for (auto& event : events) {
+      tracker.Close(event.stamp);
+   }
+   EXPECT_EQ(0u, tracker.Depth());
+
+   // closes 0, 2, 4 and 6 are sampled, depths 0, 2, 4 and 6
+   uint64_t samples = 0;
+   for (const auto& bucket : tracker.TakeSnapshot().depth) {
+      samples += bucket.samples;
+   }
+   EXPECT_EQ(4u, samples);
+}
+
+TEST_F(QueueLatencyTrackerTest, ProducersAndConsumersOnManyThreads) {
+   QueueLatencyTracker tracker(16, true);
+   std::mutex mutex;
+   std::condition_variable ready;
+   std::deque<Event> queue;
+   const int kPerProducer = 5000;
+   const int kProducers = 2;
+
+   std::vector<std::thread> threads;
+   for (int p = 0; p < kProducers; ++p) {
+      threads.emplace_back([&] {
+         for (int i = 0; i < kPerProducer; ++i) {
+            Event event;
+            event.payload = i;
+            tracker.Stamp(event.stamp);
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(event);
+            ready.notify_one();
+         }
+      });
+   }
+   std::atomic<int> consumed(0);
+   for (int c = 0; c < 2; ++c) {
+      threads.emplace_back([&] {
+         while (consumed.load() < kPerProducer * kProducers) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!ready.wait_for(lock, std::chrono::milliseconds(1), [&] { return !queue.empty(); })) {
+               continue;
+            }
+            Event event = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            tracker.Close(event.stamp);
+            ++consumed;
+         }
+      });
+   }
+   for (auto& thread : threads) {
+      thread.join();
+   }
+
+   auto snapshot = tracker.TakeSnapshot();
+   EXPECT_EQ(kPerProducer * kProducers, snapshot.count);
+   EXPECT_LE(snapshot.minTime, snapshot.Average());
+   EXPECT_GE(snapshot.maxTime, snapshot.Average());
+   EXPECT_EQ(0u, tracker.Depth());
+   uint64_t samples = 0;
+   for (const auto& bucket : snapshot.depth) {
+      samples += bucket.samples;
+   }
+   EXPECT_EQ(static_cast<uint64_t>(kPerProducer * kProducers / 16), samples);
+}
+
+TEST_F(QueueLatencyTrackerTest, CacheLineAlignedOnTheHeap) {
+   std::vector<std::unique_ptr<QueueLatencyTracker>> heap;
+   for (int i = 0; i < 8; ++i) {
+      heap.emplace_back(new QueueLatencyTracker);
+      EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(heap.back().get()) % 64);
+   }
+}
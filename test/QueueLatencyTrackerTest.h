@@ -0,0 +1,22 @@
+/*
+ * File:   QueueLatencyTrackerTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class QueueLatencyTrackerTest : public ::testing::Test {
+public:
+
+   QueueLatencyTrackerTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
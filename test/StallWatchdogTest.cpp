@@ -0,0 +1,157 @@
+#include "StallWatchdogTest.h"
+#include "StallWatchdog.h"
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+   typedef std::chrono::milliseconds milliseconds;
+   typedef StallWatchdog::clock clock;
+
+   // Collects the reports from the monitor thread
+   struct Reports {
+      std::mutex mutex;
+      std::vector<StallWatchdog::StallReport> reports;
+
+      StallWatchdog::StallCallback Callback() {
+         return [this](const StallWatchdog::StallReport& report) {
+            std::lock_guard<std::mutex> lock(mutex);
+            reports.push_back(report);
+         };
+      }
+
+      size_t Count() {
+         std::lock_guard<std::mutex> lock(mutex);
+         return reports.size();
+      }
+
+      bool WaitFor(size_t expected) {
+         auto giveUp = clock::now() + std::chrono::seconds(5);
+         while (Count() < expected && clock::now() < giveUp) {
+            std::this_thread::sleep_for(milliseconds(1));
+         }
+         return Count() >= expected;
+      }
+   };
+}
+
+TEST_F(StallWatchdogTest, RegisterAndUnregister) {
+   Reports reports;
+   StallWatchdog watchdog(milliseconds(5), reports.Callback());
+   EXPECT_EQ(0u, watchdog.RegisteredCount());
+   {
+      auto first = watchdog.Register(milliseconds(100), "first");
+      auto second = watchdog.Register(milliseconds(100), "second");
+      EXPECT_EQ(2u, watchdog.RegisteredCount());
+      auto moved = std::move(first);
+      EXPECT_EQ(2u, watchdog.RegisteredCount());
+   }
+   EXPECT_EQ(0u, watchdog.RegisteredCount());
+}
+
+TEST_F(StallWatchdogTest, HeartbeatingThreadIsNotReported) {
+   Reports reports;
+   StallWatchdog watchdog(milliseconds(2), reports.Callback());
+   std::thread worker([&] {
+      auto heartbeat = watchdog.Register(milliseconds(100), "busy");
+      auto stop = clock::now() + milliseconds(200);
+      while (clock::now() < stop) {
+         heartbeat.Heartbeat();
+         std::this_thread::sleep_for(milliseconds(1));
+      }
+   });
+   worker.join();
+   EXPECT_EQ(0u, reports.Count());
+   EXPECT_EQ(0u, watchdog.StallCount());
+}
+
+TEST_F(StallWatchdogTest, StalledThreadIsReportedOnce) {
+   Reports reports;
+   StallWatchdog watchdog(milliseconds(2), reports.Callback());
+   std::thread::id workerId;
+   std::thread worker([&] {
+      workerId = std::this_thread::get_id();
+      auto heartbeat = watchdog.Register(milliseconds(20), "wedged");
+      heartbeat.Heartbeat();
+      std::this_thread::sleep_for(milliseconds(150));
+   });
+   worker.join();
+
+   ASSERT_EQ(1u, reports.Count());
+   EXPECT_EQ(1u, watchdog.StallCount());
+   EXPECT_EQ(workerId, reports.reports[0].threadId);
+   EXPECT_EQ("wedged", reports.reports[0].name);
+   EXPECT_GT(reports.reports[0].stalled, std::chrono::nanoseconds(milliseconds(20)));
+   EXPECT_TRUE(reports.reports[0].backtrace.empty());
+}
+
+TEST_F(StallWatchdogTest, RecoveredThreadIsReportedAgain) {
+   Reports reports;
+   StallWatchdog watchdog(milliseconds(2), reports.Callback());
+   std::atomic<bool> stop(false);
+   std::thread worker([&] {
+      auto heartbeat = watchdog.Register(milliseconds(20), "flaky");
+      for (int stall = 0; stall < 2; ++stall) {
+         heartbeat.Heartbeat();
+         std::this_thread::sleep_for(milliseconds(80));
+      }
+      while (!stop) {
+         heartbeat.Heartbeat();
+         std::this_thread::sleep_for(milliseconds(1));
+      }
+   });
+   EXPECT_TRUE(reports.WaitFor(2));
+   stop = true;
+   worker.join();
+   EXPECT_EQ(2u, reports.Count());
+}
+
+TEST_F(StallWatchdogTest, BacktraceOfStalledThread) {
+   Reports reports;
+   StallWatchdog watchdog(milliseconds(2), reports.Callback(), true);
+   std::thread worker([&] {
+      auto heartbeat = watchdog.Register(milliseconds(20), "traced");
+      std::this_thread::sleep_for(milliseconds(150));
+   });
+   worker.join();
+   ASSERT_EQ(1u, reports.Count());
+   EXPECT_FALSE(reports.reports[0].backtrace.empty());
+}
+
+TEST_F(StallWatchdogTest, BacktraceStartsInTheStalledCode) {
+   Reports reports;
+   StallWatchdog watchdog(milliseconds(2), reports.Callback(), true);
+   std::thread worker([&] {
+      auto heartbeat = watchdog.Register(milliseconds(20), "sleeping");
+      std::this_thread::sleep_for(milliseconds(150));
+   });
+   worker.join();
+   ASSERT_EQ(1u, reports.Count());
+   ASSERT_FALSE(reports.reports[0].backtrace.empty());
+   // the handler and the signal trampoline are skipped, the stack starts in the sleep
+   EXPECT_NE(std::string::npos, reports.reports[0].backtrace[0].find("sleep")) << reports.reports[0].backtrace[0];
+}
+
+TEST_F(StallWatchdogTest, PreviousSignalHandlerIsRestored) {
+   struct sigaction ignore;
+   std::memset(&ignore, 0, sizeof(ignore));
+   ignore.sa_handler = SIG_IGN;
+   sigemptyset(&ignore.sa_mask);
+   struct sigaction original;
+   ASSERT_EQ(0, sigaction(SIGUSR2, &ignore, &original));
+   {
+      Reports reports;
+      StallWatchdog watchdog(milliseconds(2), reports.Callback(), true, SIGUSR2);
+      struct sigaction installed;
+      sigaction(SIGUSR2, nullptr, &installed);
+      EXPECT_NE(SIG_IGN, installed.sa_handler);
+   }
+   struct sigaction restored;
+   sigaction(SIGUSR2, &original, &restored);
+   EXPECT_EQ(SIG_IGN, restored.sa_handler);
+}
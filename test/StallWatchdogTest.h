@@ -0,0 +1,22 @@
+/*
+ * File:   StallWatchdogTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class StallWatchdogTest : public ::testing::Test {
+public:
+
+   StallWatchdogTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
@@ -0,0 +1,203 @@
+#include "StatsSerializationTest.h"
+#include "StatsSerialization.h"
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <system_error>
+
+namespace {
+   const uint8_t* Bytes(const std::string& serialized) {
+      return reinterpret_cast<const uint8_t*>(serialized.data());
+   }
+
+   // 1000 measurements spread from 1 us to ~1 ms
+   void FillLatencies(TimeStats& stats, long long offset) {
+      stats.EnableHistogram();
+      for (long long i = 1; i <= 1000; ++i) {
+         stats.Save(offset + i * i);
+      }
+   }
+}
+
+TEST_F(StatsSerializationTest, RoundTripWithoutHistogram) {
+   TimeStats stats;
+   stats.Save(100);
+   stats.Save(300);
+   SerializedStats record = SerializedStats::Flush(stats);
+   EXPECT_FALSE(record.HasHistogram());
+
+   std::string bytes = record.Serialize();
+   EXPECT_LT(bytes.size(), 16u);
+   SerializedStatsView view;
+   size_t consumed = 0;
+   ASSERT_TRUE(view.Parse(Bytes(bytes), bytes.size(), &consumed));
+   EXPECT_EQ(bytes.size(), consumed);
+   EXPECT_EQ(SerializedStats::kVersion, view.Version());
+   EXPECT_EQ(2, view.Count());
+   EXPECT_EQ(400, view.TotalTime());
+   EXPECT_EQ(100, view.MinTime());
+   EXPECT_EQ(300, view.MaxTime());
+   EXPECT_FALSE(view.HasHistogram());
+}
+
+TEST_F(StatsSerializationTest, EmptyStatsRoundTrip) {
+   TimeStats stats;
+   std::string bytes = SerializedStats::Flush(stats).Serialize();
+   SerializedStatsView view;
+   ASSERT_TRUE(view.Parse(Bytes(bytes), bytes.size()));
+   EXPECT_EQ(0, view.Count());
+   EXPECT_EQ(std::numeric_limits<long long>::max(), view.MinTime());
+}
+
+TEST_F(StatsSerializationTest, HistogramIsCompactAndExact) {
+   TimeStats stats;
+   FillLatencies(stats, 1000);
+   const long long p50 = stats.Percentile(50);
+   const long long p999 = stats.Percentile(99.9);
+   std::string bytes = SerializedStats::Flush(stats).Serialize();
+   // about 300 non-empty buckets of two bytes each
+   EXPECT_LT(bytes.size(), 1024u);
+
+   SerializedStatsView view;
+   ASSERT_TRUE(view.Parse(Bytes(bytes), bytes.size()));
+   ASSERT_TRUE(view.HasHistogram());
+   SerializedStats copy;
+   copy.Merge(view);
+   EXPECT_EQ(1000, copy.Count());
+   EXPECT_EQ(1000u, copy.Histogram().Count());
+   EXPECT_EQ(p50, copy.Percentile(50));
+   EXPECT_EQ(p999, copy.Percentile(99.9));
+}
+
+TEST_F(StatsSerializationTest, MergeMatchesMergedTimeStats) {
+   TimeStats first, second, total;
+   FillLatencies(first, 0);
+   FillLatencies(second, 500000);
+   total.EnableHistogram();
+   total.Merge(first);
+   total.Merge(second);
+
+   SerializedStats fleet;
+   fleet.Merge(SerializedStats::Flush(first));
+   std::string bytes = SerializedStats::Flush(second).Serialize();
+   SerializedStatsView view;
+   ASSERT_TRUE(view.Parse(Bytes(bytes), bytes.size()));
+   fleet.Merge(view);
+
+   for (double percentile : {1.0, 50.0, 90.0, 99.0, 99.9}) {
+      EXPECT_EQ(total.Percentile(percentile), fleet.Percentile(percentile)) << percentile;
+   }
+   TimeStats::Metrics expected = total.FlushAsMetrics();
+   EXPECT_EQ(expected, fleet.AsMetrics());
+}
+
+TEST_F(StatsSerializationTest, MixedHistogramsDropTheHistogram) {
+   TimeStats withHistogram, without, empty;
+   FillLatencies(withHistogram, 0);
+   without.Save(42);
+   const SerializedStats first = SerializedStats::Flush(withHistogram);
+   const SerializedStats second = SerializedStats::Flush(without);
+   const SerializedStats none = SerializedStats::Flush(empty);
+   ASSERT_TRUE(first.HasHistogram());
+   ASSERT_FALSE(second.HasHistogram());
+
+   SerializedStats fleet;
+   fleet.Merge(first);
+   fleet.Merge(none); // no measurements, the histogram still covers all
+   EXPECT_TRUE(fleet.HasHistogram());
+   fleet.Merge(second);
+   EXPECT_EQ(1001, fleet.Count());
+   EXPECT_FALSE(fleet.HasHistogram());
+   EXPECT_EQ(0, fleet.Percentile(50));
+   fleet.Merge(first);
+   EXPECT_FALSE(fleet.HasHistogram());
+
+   // the same the other way around, and through a view
+   SerializedStats reversed;
+   reversed.Merge(second);
+   const std::string bytes = first.Serialize();
+   SerializedStatsView view;
+   ASSERT_TRUE(view.Parse(Bytes(bytes), bytes.size()));
+   reversed.Merge(view);
+   EXPECT_EQ(1001, reversed.Count());
+   EXPECT_FALSE(reversed.HasHistogram());
+   EXPECT_EQ(0, reversed.Percentile(50));
+}
+
+TEST_F(StatsSerializationTest, RejectsBrokenRecords) {
+   TimeStats stats;
+   FillLatencies(stats, 0);
+   std::string bytes = SerializedStats::Flush(stats).Serialize();
+   SerializedStatsView view;
+   EXPECT_FALSE(view.Parse(Bytes(bytes), bytes.size() - 1));
+   EXPECT_FALSE(view.Parse(Bytes(bytes), 3));
+
+   std::string badMagic = bytes;
+   badMagic[0] = 'X';
+   EXPECT_FALSE(view.Parse(Bytes(badMagic), badMagic.size()));
+
+   std::string newer = bytes;
+   newer[4] = static_cast<char>(SerializedStats::kVersion + 1);
+   EXPECT_FALSE(view.Parse(Bytes(newer), newer.size()));
+
+   std::string unversioned = bytes;
+   unversioned[4] = 0;
+   EXPECT_FALSE(view.Parse(Bytes(unversioned), unversioned.size()));
+}
+
+TEST_F(StatsSerializationTest, SkipsUnknownTrailingFields) {
+   TimeStats stats;
+   stats.Save(42);
+   std::string bytes = SerializedStats::Flush(stats).Serialize();
+   // a one byte body length, as written for a small record
+   ASSERT_LT(static_cast<uint8_t>(bytes[6]), 0x7f);
+   bytes[6] = static_cast<char>(bytes[6] + 2);
+   bytes += "\x01\x02";
+   bytes[5] = static_cast<char>(bytes[5] | 0x80); // a flag from a newer writer
+   bytes += SerializedStats::Flush(stats).Serialize();
+
+   SerializedStatsView view;
+   size_t consumed = 0;
+   ASSERT_TRUE(view.Parse(Bytes(bytes), bytes.size(), &consumed));
+   EXPECT_EQ(1, view.Count());
+   EXPECT_EQ(42, view.MaxTime());
+   ASSERT_TRUE(view.Parse(Bytes(bytes) + consumed, bytes.size() - consumed));
+   EXPECT_EQ(0, view.Count()); // flushed by the first record
+}
+
+TEST_F(StatsSerializationTest, ReadsMappedFile) {
+   char path[] = "/tmp/StatsSerializationTestXXXXXX";
+   int fd = mkstemp(path);
+   ASSERT_GE(fd, 0);
+   close(fd);
+   {
+      std::ofstream out(path, std::ios::binary);
+      for (long long offset : {0LL, 100000LL, 200000LL}) {
+         TimeStats stats;
+         FillLatencies(stats, offset);
+         out << SerializedStats::Flush(stats).Serialize();
+      }
+   }
+
+   {
+      SerializedStatsFile file(path);
+      SerializedStats fleet;
+      SerializedStatsView view;
+      size_t offset = 0;
+      int records = 0;
+      while (file.Next(offset, view)) {
+         fleet.Merge(view);
+         ++records;
+      }
+      EXPECT_EQ(3, records);
+      EXPECT_EQ(file.Size(), offset);
+      EXPECT_EQ(3000, fleet.Count());
+      EXPECT_EQ(1, fleet.MinTime());
+      EXPECT_EQ(1200000, fleet.MaxTime());
+   }
+   std::remove(path);
+
+   EXPECT_THROW(SerializedStatsFile("/tmp/does/not/exist"), std::system_error);
+}
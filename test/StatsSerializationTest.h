@@ -0,0 +1,22 @@
+/*
+ * File:   StatsSerializationTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class StatsSerializationTest : public ::testing::Test {
+public:
+
+   StatsSerializationTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
@@ -0,0 +1,167 @@
+#include "TaskSchedulerTest.h"
+#include "TaskScheduler.h"
+#include "WorkStealingPool.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+   typedef std::chrono::milliseconds milliseconds;
+   typedef TaskScheduler::clock clock;
+
+   void WaitFor(const std::atomic<int>& counter, int expected) {
+      auto giveUp = clock::now() + std::chrono::seconds(5);
+      while (counter.load() < expected && clock::now() < giveUp) {
+         std::this_thread::sleep_for(milliseconds(1));
+      }
+   }
+}
+
+TEST_F(TaskSchedulerTest, PoolRunsAllWork) {
+   std::atomic<int> done{0};
+   {
+      WorkStealingPool pool(3);
+      for (int i = 0; i < 1000; ++i) {
+         pool.Submit([&] { ++done; });
+      }
+   }
+   EXPECT_EQ(1000, done.load());
+}
+
+TEST_F(TaskSchedulerTest, PoolStealsFromBlockedWorker) {
+   std::atomic<bool> release{false};
+   std::atomic<int> done{0};
+   // releases the blocked worker on every path, before the pool joins it
+   struct Release {
+      std::atomic<bool>& release;
+      ~Release() { release.store(true); }
+   };
+   WorkStealingPool pool(2);
+   Release releaseOnExit{release};
+   pool.Submit([&] { while (!release.load()) { std::this_thread::yield(); } });
+   // half of these land in the queue of the blocked worker
+   for (int i = 0; i < 10; ++i) {
+      pool.Submit([&] { ++done; });
+   }
+   WaitFor(done, 10);
+   EXPECT_EQ(10, done.load());
+   EXPECT_GT(pool.StolenCount(), 0u);
+}
+
+TEST_F(TaskSchedulerTest, OneShotRunsOnce) {
+   std::atomic<int> runs{0};
+   TaskScheduler scheduler(2);
+   auto id = scheduler.ScheduleOnce("once", clock::now() + milliseconds(2), [&] { ++runs; });
+   EXPECT_EQ(1u, scheduler.TaskCount());
+   WaitFor(runs, 1);
+   std::this_thread::sleep_for(milliseconds(10));
+   EXPECT_EQ(1, runs.load());
+   EXPECT_EQ(0u, scheduler.TaskCount());
+   EXPECT_FALSE(scheduler.Cancel(id));
+
+   TaskScheduler::TaskMetrics metrics;
+   EXPECT_TRUE(scheduler.FlushMetrics(id, metrics));
+   EXPECT_EQ("once", metrics.name);
+   EXPECT_EQ(1, std::get<TimeStats::Index::Count>(metrics.runTime));
+   EXPECT_GE(std::get<TimeStats::Index::MinTime>(metrics.lateness), 0);
+   EXPECT_FALSE(scheduler.FlushMetrics(id, metrics)); // forgotten once flushed
+}
+
+TEST_F(TaskSchedulerTest, PeriodicStaysOnAbsoluteSchedule) {
+   std::mutex mutex;
+   std::vector<clock::time_point> starts;
+   std::atomic<int> runs{0};
+   const auto period = milliseconds(5);
+   const auto first = clock::now() + period;
+   TaskScheduler scheduler(2);
+   scheduler.SchedulePeriodic("tick", period, [&] {
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         starts.push_back(clock::now());
+      }
+      ++runs;
+      std::this_thread::sleep_for(milliseconds(2)); // would drift 2 ms a run if scheduled from completion
+   }, first);
+   WaitFor(runs, 10);
+
+   std::lock_guard<std::mutex> lock(mutex);
+   ASSERT_GE(starts.size(), 10u);
+   TaskScheduler::TaskMetrics metrics = scheduler.FlushAllMetrics().front();
+   // every run starts on or after its slot on the grid, never before it,
+   // and the lateness does not add up: by run 10 drift would be 20 ms
+   for (size_t i = 0; i < starts.size(); ++i) {
+      const clock::time_point slot = first + period * static_cast<int>(i);
+      EXPECT_TRUE(starts[i] >= slot) << "run " << i;
+      EXPECT_TRUE(starts[i] < slot + 2 * period) << "run " << i << " is "
+         << std::chrono::duration_cast<std::chrono::microseconds>(starts[i] - slot).count() << " us late";
+   }
+   // the last run may still be executing
+   EXPECT_GE(std::get<TimeStats::Index::Count>(metrics.runTime), static_cast<long long>(starts.size()) - 1);
+   EXPECT_GE(std::get<TimeStats::Index::MinTime>(metrics.runTime), 1000000);
+}
+
+TEST_F(TaskSchedulerTest, NonPositivePeriodIsRejected) {
+   TaskScheduler scheduler(1);
+   EXPECT_THROW(scheduler.SchedulePeriodic("zero", milliseconds(0), [] {}), std::invalid_argument);
+   EXPECT_THROW(scheduler.SchedulePeriodic("negative", milliseconds(-1), [] {}, clock::now()), std::invalid_argument);
+   EXPECT_EQ(0u, scheduler.TaskCount());
+}
+
+TEST_F(TaskSchedulerTest, CancelWhileRunning) {
+   std::atomic<int> runs{0};
+   TaskScheduler scheduler(1);
+   auto id = scheduler.SchedulePeriodic("slow", milliseconds(1), [&] {
+      ++runs;
+      std::this_thread::sleep_for(milliseconds(5));
+   }, clock::now());
+   WaitFor(runs, 3);
+   scheduler.Cancel(id);
+
+   std::this_thread::sleep_for(milliseconds(10));
+   TaskScheduler::TaskMetrics metrics;
+   EXPECT_FALSE(scheduler.FlushMetrics(id, metrics));
+   EXPECT_EQ(0u, scheduler.TaskCount());
+}
+
+TEST_F(TaskSchedulerTest, MissedRunsAreCounted) {
+   std::atomic<int> runs{0};
+   TaskScheduler scheduler(1);
+   auto id = scheduler.SchedulePeriodic("slow", milliseconds(1), [&] {
+      ++runs;
+      std::this_thread::sleep_for(milliseconds(5));
+   }, clock::now());
+   WaitFor(runs, 3);
+   TaskScheduler::TaskMetrics metrics;
+   ASSERT_TRUE(scheduler.FlushMetrics(id, metrics));
+   EXPECT_GE(metrics.missedRuns, 4u);
+}
+
+TEST_F(TaskSchedulerTest, CancelStopsPeriodic) {
+   std::atomic<int> runs{0};
+   TaskScheduler scheduler(2);
+   auto id = scheduler.SchedulePeriodic("tick", milliseconds(1), [&] { ++runs; });
+   WaitFor(runs, 2);
+   EXPECT_TRUE(scheduler.Cancel(id));
+   EXPECT_FALSE(scheduler.Cancel(id));
+   std::this_thread::sleep_for(milliseconds(5));
+   int after = runs.load();
+   std::this_thread::sleep_for(milliseconds(10));
+   EXPECT_EQ(after, runs.load());
+}
+
+TEST_F(TaskSchedulerTest, ManyTasksFewThreads) {
+   const int kTasks = 50;
+   std::atomic<int> runs{0};
+   TaskScheduler scheduler(2);
+   for (int i = 0; i < kTasks; ++i) {
+      scheduler.SchedulePeriodic("task" + std::to_string(i), milliseconds(2), [&] { ++runs; });
+   }
+   EXPECT_EQ(static_cast<size_t>(kTasks), scheduler.TaskCount());
+   WaitFor(runs, 3 * kTasks);
+   EXPECT_GE(runs.load(), 3 * kTasks);
+   EXPECT_EQ(static_cast<size_t>(kTasks), scheduler.FlushAllMetrics().size());
+   EXPECT_NE(std::string::npos, scheduler.FlushAsString().find("task49: Runs: "));
+}
@@ -0,0 +1,22 @@
+/*
+ * File:   TaskSchedulerTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class TaskSchedulerTest : public ::testing::Test {
+public:
+
+   TaskSchedulerTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
@@ -4,8 +4,13 @@
 #include <limits>
 #include <thread>
 #include <chrono>
+#include <cstdlib>
+#include <vector>
 
 #include "TriggerTimeStats.h"
+#include "VirtualClock.h"
+#include "TscClock.h"
+#include "ClockProbe.h"
 
 namespace {
    const long long kNanoSecMinFake = 100;
@@ -60,16 +65,18 @@ TEST_F(TimeStatsTest, SimpleSetup2) {
 
 
 TEST_F(TimeStatsTest, TimeTrigger1s) {
-   TimeStats stats;
+   // simulated time, the 1 ms calls and the 1 s interval take no real time
+   BasicTimeStats<VirtualClock> stats;
    using namespace std::chrono_literals;
    long long counter = 0;
    while (stats.ElapsedSec() <= 1) {
       ++counter;
       {
-         TriggerTimeStats trigger{stats}; // implicit &
-         std::this_thread::sleep_for(1ms);
+         BasicTriggerTimeStats<VirtualClock> trigger{stats}; // implicit &
+         VirtualClock::Advance(1ms + 1us);
       }
    }
+   EXPECT_EQ(1999, counter);
    TimeStats::Metrics metrics = stats.FlushAsMetrics();
    long long expectedMinNs = 1 * 1000000;
    EXPECT_GT(std::get<TimeStats::Index::MinTime>(metrics), expectedMinNs);
@@ -83,6 +90,20 @@ TEST_F(TimeStatsTest, TimeTrigger1s) {
 }
 
 
+// The members are defined in the header, any clock links
+TEST_F(TimeStatsTest, OtherClocks) {
+   BasicTimeStats<TscClock> tscStats;
+   BasicTimeStats<AutoClock> autoStats;
+   {
+      BasicTriggerTimeStats<TscClock> tscTrigger{tscStats};
+      BasicTriggerTimeStats<AutoClock> autoTrigger{autoStats};
+   }
+   EXPECT_TRUE(tscStats.HasMetrics());
+   EXPECT_TRUE(autoStats.HasMetrics());
+   EXPECT_EQ(0u, tscStats.ElapsedSec());
+}
+
+
 TEST_F(TimeStatsTest, SkipTrigger) {
    TimeStats stats;
    {
@@ -103,3 +124,157 @@ TEST_F(TimeStatsTest, NoSkipTrigger) {
 }
 
 
+
+TEST_F(TimeStatsTest, SaveBatchEqualsSave) {
+   const std::string fastest = TimeStats::BatchKernel();
+   const std::vector<std::string> kernels = TimeStats::BatchKernels();
+   ASSERT_FALSE(kernels.empty());
+   EXPECT_EQ(fastest, kernels.front());
+   EXPECT_EQ("scalar", kernels.back());
+   EXPECT_FALSE(TimeStats::UseBatchKernel("avx512"));
+
+   // every kernel the CPU runs, on the same batches, including all tail lengths
+   for (const auto& kernel : kernels) {
+      ASSERT_TRUE(TimeStats::UseBatchKernel(kernel));
+      EXPECT_EQ(kernel, TimeStats::BatchKernel());
+      std::srand(1234);
+      for (size_t size = 0; size < 70; ++size) {
+         std::vector<int64_t> batch(size);
+         for (auto& ns : batch) {
+            ns = static_cast<int64_t>(std::rand()) * 1000 + std::rand() % 1000;
+         }
+         TimeStats scalar;
+         TimeStats batched;
+         for (auto ns : batch) {
+            scalar.Save(ns);
+         }
+         batched.SaveBatch(batch.data(), batch.size());
+         EXPECT_EQ(scalar.FlushAsMetrics(), batched.FlushAsMetrics()) << "size: " << size << ", kernel: " << kernel;
+      }
+
+      // the extremes in every lane and in the tail
+      for (size_t size = 1; size < 12; ++size) {
+         for (size_t position = 0; position < size; ++position) {
+            std::vector<int64_t> low(size, 500);
+            std::vector<int64_t> high(size, 500);
+            low[position] = 1;
+            high[position] = 900;
+            TimeStats lowStats;
+            TimeStats highStats;
+            lowStats.SaveBatch(low.data(), low.size());
+            highStats.SaveBatch(high.data(), high.size());
+            EXPECT_EQ(1, std::get<TimeStats::Index::MinTime>(lowStats.FlushAsMetrics())) << "size: " << size << ", kernel: " << kernel;
+            EXPECT_EQ(900, std::get<TimeStats::Index::MaxTime>(highStats.FlushAsMetrics())) << "size: " << size << ", kernel: " << kernel;
+         }
+      }
+   }
+   TimeStats::UseBatchKernel(fastest);
+}
+
+TEST_F(TimeStatsTest, SaveBatchFoldsIntoExisting) {
+   TimeStats stats;
+   stats.Save(kNanoSecMinFake);
+   const int64_t batch[] = {150, 250, kNanoSecMaxFake, 200, 200};
+   stats.SaveBatch(batch, 5);
+   TimeStats::Metrics metrics = stats.FlushAsMetrics();
+   EXPECT_EQ(kNanoSecMinFake, std::get<TimeStats::Index::MinTime>(metrics));
+   EXPECT_EQ(kNanoSecMaxFake, std::get<TimeStats::Index::MaxTime>(metrics));
+   EXPECT_EQ(6, std::get<TimeStats::Index::Count>(metrics));
+   EXPECT_EQ(1200, std::get<TimeStats::Index::TotalTime>(metrics));
+   EXPECT_EQ(kAverage, std::get<TimeStats::Index::Average>(metrics));
+}
+
+TEST_F(TimeStatsTest, KeepsSlowestWithTags) {
+   TimeStats stats(3);
+   const long long durations[] = {500, 100, 900, 300, 700, 200, 800};
+   for (uint64_t tag = 0; tag < 7; ++tag) {
+      stats.Save(durations[tag], tag);
+   }
+   TimeStats::Samples slowest;
+   TimeStats::Metrics metrics = stats.FlushAsMetrics(slowest);
+   EXPECT_EQ(7, std::get<TimeStats::Index::Count>(metrics));
+   ASSERT_EQ(3u, slowest.size());
+   EXPECT_EQ(900, slowest[0].ns);
+   EXPECT_EQ(2u, slowest[0].tag);
+   EXPECT_EQ(800, slowest[1].ns);
+   EXPECT_EQ(6u, slowest[1].tag);
+   EXPECT_EQ(700, slowest[2].ns);
+   EXPECT_EQ(4u, slowest[2].tag);
+
+   // the flush starts a new interval
+   stats.Save(50, 42);
+   stats.FlushAsMetrics(slowest);
+   ASSERT_EQ(1u, slowest.size());
+   EXPECT_EQ(42u, slowest[0].tag);
+}
+
+TEST_F(TimeStatsTest, SlowestDisabledByDefault) {
+   TimeStats stats;
+   stats.Save(kNanoSecMaxFake, 1);
+   TimeStats::Samples slowest;
+   stats.FlushAsMetrics(slowest);
+   EXPECT_TRUE(slowest.empty());
+}
+
+TEST_F(TimeStatsTest, SlowestFromBatch) {
+   TimeStats stats(2);
+   const int64_t batch[] = {150, 250, kNanoSecMaxFake, 200, 200};
+   const uint64_t tags[] = {1, 2, 3, 4, 5};
+   stats.SaveBatch(batch, 5, tags);
+   stats.SaveBatch(batch, 2); // untagged, below the current floor
+   TimeStats::Samples slowest;
+   stats.FlushAsMetrics(slowest);
+   ASSERT_EQ(2u, slowest.size());
+   EXPECT_EQ(3u, slowest[0].tag);
+   EXPECT_EQ(2u, slowest[1].tag);
+}
+
+TEST_F(TimeStatsTest, SlowestInString) {
+   TimeStats stats(1);
+   stats.Save(kNanoSecMinFake, 7);
+   stats.Save(kNanoSecMaxFake, 9);
+   std::string metrics = stats.FlushAsString();
+   std::string expected = "Count: 2, Min time: 100";
+   expected += " ns, Max time: 300 ns : 0 us,";
+   expected += " Average: 200 ns : 0 us, Slowest: 300 ns (tag 9)";
+   EXPECT_EQ(expected, metrics);
+}
+
+
+TEST_F(TimeStatsTest, Percentiles) {
+   TimeStats stats;
+   stats.Save(100);
+   EXPECT_EQ(0, stats.Percentile(50)); // histogram not enabled
+   stats.FlushAsMetrics();
+
+   stats.EnableHistogram();
+   for (long long value = 1; value <= 100; ++value) {
+      stats.Save(value);
+   }
+   EXPECT_EQ(50, stats.Percentile(50));
+   EXPECT_EQ(99, stats.Percentile(99));
+   EXPECT_NE(std::string::npos, stats.FlushAsString().find("p99: 99 ns"));
+   EXPECT_EQ(0, stats.Percentile(99));
+}
+
+TEST_F(TimeStatsTest, Merge) {
+   TimeStats first(2);
+   TimeStats second(2);
+   first.EnableHistogram();
+   second.EnableHistogram();
+   first.Save(100, 1);
+   first.Save(400, 2);
+   second.Save(300, 3);
+   second.Save(50, 4);
+   first.Merge(second);
+   EXPECT_EQ(4u, first.Histogram().Count());
+   TimeStats::Samples slowest;
+   TimeStats::Metrics metrics = first.FlushAsMetrics(slowest);
+   EXPECT_EQ(50, std::get<TimeStats::Index::MinTime>(metrics));
+   EXPECT_EQ(400, std::get<TimeStats::Index::MaxTime>(metrics));
+   EXPECT_EQ(4, std::get<TimeStats::Index::Count>(metrics));
+   EXPECT_EQ(850, std::get<TimeStats::Index::TotalTime>(metrics));
+   ASSERT_EQ(2u, slowest.size());
+   EXPECT_EQ(2u, slowest[0].tag);
+   EXPECT_EQ(3u, slowest[1].tag);
+}
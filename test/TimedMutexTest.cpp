@@ -0,0 +1,169 @@
+#include "TimedMutexTest.h"
+#include "TimedMutex.h"
+#include "ThreadSafeStopWatch.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+namespace {
+   typedef std::chrono::milliseconds milliseconds;
+
+   bool IsRegistered(const std::string& name) {
+      for (const auto& stats : LockRegistry::Instance().TopContended(LockRegistry::Instance().Size())) {
+         if (stats.name == name) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   // Holds mutex while another thread locks it, returns when that thread has it
+   template<typename Mutex> void ContendOnce(Mutex& mutex, milliseconds held) {
+      std::unique_lock<Mutex> lock(mutex);
+      std::atomic<bool> started(false);
+      std::thread waiter([&mutex, &started] {
+         started = true;
+         std::lock_guard<Mutex> inner(mutex);
+      });
+      while (!started) {
+         std::this_thread::yield();
+      }
+      std::this_thread::sleep_for(held);
+      lock.unlock();
+      waiter.join();
+   }
+}
+
+TEST_F(TimedMutexTest, UncontendedIsCountedAndSampled) {
+   TimedMutex mutex("uncontended", 4);
+   for (int i = 0; i < 10; ++i) {
+      std::lock_guard<TimedMutex> lock(mutex);
+   }
+   const LockStats stats = mutex.Stats();
+   EXPECT_EQ("uncontended", stats.name);
+   EXPECT_EQ(10u, stats.acquisitions);
+   EXPECT_EQ(0u, stats.contended);
+   EXPECT_EQ(0, stats.waitTotalNs);
+   EXPECT_EQ(2u, stats.holdSamples); // the 4th and the 8th
+   EXPECT_EQ(0, stats.AverageWaitNs());
+}
+
+TEST_F(TimedMutexTest, NoSamplingOnlyMeasuresContended) {
+   TimedMutex mutex("unsampled", 0);
+   for (int i = 0; i < 100; ++i) {
+      std::lock_guard<TimedMutex> lock(mutex);
+   }
+   EXPECT_EQ(100u, mutex.Stats().acquisitions);
+   EXPECT_EQ(0u, mutex.Stats().holdSamples);
+
+   ContendOnce(mutex, milliseconds(20));
+   const LockStats stats = mutex.Stats();
+   EXPECT_EQ(102u, stats.acquisitions);
+   EXPECT_EQ(1u, stats.contended);
+   EXPECT_EQ(1u, stats.holdSamples); // the waiter's hold
+}
+
+TEST_F(TimedMutexTest, ContendedWaitIsMeasured) {
+   TimedMutex mutex("contended", 0);
+   ContendOnce(mutex, milliseconds(20));
+   const LockStats stats = mutex.Stats();
+   EXPECT_EQ(2u, stats.acquisitions);
+   EXPECT_EQ(1u, stats.contended);
+   EXPECT_GE(stats.waitTotalNs, 10 * 1000 * 1000);
+   EXPECT_EQ(stats.waitTotalNs, stats.waitMaxNs);
+   EXPECT_EQ(0.5, stats.ContendedShare());
+}
+
+TEST_F(TimedMutexTest, HoldTimeIsMeasured) {
+   TimedMutex mutex("held", 1);
+   {
+      std::lock_guard<TimedMutex> lock(mutex);
+      std::this_thread::sleep_for(milliseconds(10));
+   }
+   const LockStats stats = mutex.Stats();
+   EXPECT_EQ(1u, stats.holdSamples);
+   EXPECT_GE(stats.holdMaxNs, 10 * 1000 * 1000);
+   EXPECT_EQ(stats.holdTotalNs, stats.AverageHoldNs());
+}
+
+TEST_F(TimedMutexTest, TryLock) {
+   TimedMutex mutex("try", 0);
+   ASSERT_TRUE(mutex.try_lock());
+   std::thread other([&mutex] { EXPECT_FALSE(mutex.try_lock()); });
+   other.join();
+   mutex.unlock();
+   EXPECT_EQ(1u, mutex.Stats().acquisitions);
+   EXPECT_EQ(0u, mutex.Stats().contended);
+}
+
+TEST_F(TimedMutexTest, SharedMutex) {
+   TimedSharedMutex mutex("shared", 0);
+   {
+      std::shared_lock<TimedSharedMutex> first(mutex);
+      std::shared_lock<TimedSharedMutex> second(mutex);
+   }
+   EXPECT_EQ(2u, mutex.SharedStats().acquisitions);
+   EXPECT_EQ(0u, mutex.SharedStats().contended);
+   EXPECT_EQ("shared (shared)", mutex.SharedStats().name);
+
+   {
+      std::unique_lock<TimedSharedMutex> writer(mutex);
+      std::thread reader([&mutex] {
+         std::shared_lock<TimedSharedMutex> lock(mutex);
+      });
+      std::this_thread::sleep_for(milliseconds(20));
+      writer.unlock();
+      reader.join();
+   }
+   EXPECT_EQ(3u, mutex.SharedStats().acquisitions);
+   EXPECT_EQ(1u, mutex.SharedStats().contended);
+   EXPECT_GE(mutex.SharedStats().waitMaxNs, 10 * 1000 * 1000);
+   EXPECT_EQ(1u, mutex.Stats().acquisitions);
+   EXPECT_EQ(0u, mutex.Stats().contended);
+
+   ContendOnce(mutex, milliseconds(20));
+   EXPECT_EQ(1u, mutex.Stats().contended);
+}
+
+TEST_F(TimedMutexTest, RegistryFollowsLifetime) {
+   const size_t before = LockRegistry::Instance().Size();
+   {
+      TimedMutex mutex("scoped");
+      TimedSharedMutex shared("scoped shared");
+      EXPECT_EQ(before + 3, LockRegistry::Instance().Size());
+      EXPECT_TRUE(IsRegistered("scoped"));
+      EXPECT_TRUE(IsRegistered("scoped shared (shared)"));
+   }
+   EXPECT_EQ(before, LockRegistry::Instance().Size());
+   EXPECT_FALSE(IsRegistered("scoped"));
+}
+
+TEST_F(TimedMutexTest, TopContended) {
+   TimedMutex quiet("quiet", 0);
+   TimedMutex busy("busy", 0);
+   TimedMutex busier("busier", 0);
+   {
+      std::lock_guard<TimedMutex> lock(quiet);
+   }
+   ContendOnce(busy, milliseconds(10));
+   ContendOnce(busier, milliseconds(60));
+
+   const std::vector<LockStats> top = LockRegistry::Instance().TopContended(2);
+   ASSERT_EQ(2u, top.size());
+   EXPECT_EQ("busier", top[0].name);
+   EXPECT_EQ("busy", top[1].name);
+
+   const std::string str = LockRegistry::Instance().TopContendedAsString(1);
+   EXPECT_EQ(0u, str.find("busier: Acquisitions: 2, Contended: 1, Average wait: ")) << str;
+}
+
+TEST_F(TimedMutexTest, ThreadSafeStopWatchIsRegistered) {
+   std::unique_ptr<ThreadSafeStopWatch> stopWatch(new ThreadSafeStopWatch);
+   EXPECT_TRUE(IsRegistered("ThreadSafeStopWatch"));
+   stopWatch->GetStopWatch().Restart();
+   stopWatch.reset();
+   EXPECT_FALSE(IsRegistered("ThreadSafeStopWatch"));
+}
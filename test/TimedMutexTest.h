@@ -0,0 +1,22 @@
+/*
+ * File:   TimedMutexTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class TimedMutexTest : public ::testing::Test {
+public:
+
+   TimedMutexTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
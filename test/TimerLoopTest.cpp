@@ -0,0 +1,136 @@
+#include "TimerLoopTest.h"
+#include "TimerLoop.h"
+#include "StopWatch.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+   typedef std::chrono::milliseconds milliseconds;
+   typedef TimerLoop::clock clock;
+}
+
+TEST_F(TimerLoopTest, EmptyLoopReturns) {
+   TimerLoop loop;
+   EXPECT_EQ(0u, loop.PendingCount());
+   loop.Run();
+   EXPECT_EQ(0u, loop.RunOnce(0));
+}
+
+TEST_F(TimerLoopTest, WakesInDeadlineOrder) {
+   TimerLoop loop;
+   std::vector<int> order;
+   TimerLoop::Callback third([&](bool) { order.push_back(3); });
+   TimerLoop::Callback first([&](bool) { order.push_back(1); });
+   TimerLoop::Callback second([&](bool) { order.push_back(2); });
+
+   auto now = clock::now();
+   loop.Schedule(third, now + milliseconds(6));
+   loop.Schedule(first, now + milliseconds(2));
+   loop.Schedule(second, now + milliseconds(4));
+   EXPECT_EQ(3u, loop.PendingCount());
+
+   StopWatch sw;
+   loop.Run();
+   EXPECT_GE(sw.ElapsedUs(), 5000u);
+   ASSERT_EQ(3u, order.size());
+   EXPECT_EQ(1, order[0]);
+   EXPECT_EQ(2, order[1]);
+   EXPECT_EQ(3, order[2]);
+}
+
+TEST_F(TimerLoopTest, DeadlineIsNotMissed) {
+   TimerLoop loop;
+   clock::time_point woken;
+   TimerLoop::Callback waiter([&](bool) { woken = clock::now(); });
+   auto deadline = clock::now() + milliseconds(3);
+   loop.Schedule(waiter, deadline);
+   loop.Run();
+   EXPECT_TRUE(woken >= deadline);
+}
+
+TEST_F(TimerLoopTest, EpochDeadlineIsDue) {
+   TimerLoop loop;
+   int woken = 0;
+   TimerLoop::Callback waiter([&](bool expired) { woken += expired; });
+   loop.Schedule(waiter, clock::time_point());
+   loop.Run();
+   EXPECT_EQ(1, woken);
+
+   // again after the heap has been empty, the timer was disarmed in between
+   loop.Schedule(waiter, clock::time_point());
+   loop.Run();
+   EXPECT_EQ(2, woken);
+}
+
+TEST_F(TimerLoopTest, CancelWakesWithFalse) {
+   TimerLoop loop;
+   int expired = 0;
+   int cancelled = 0;
+   TimerLoop::Callback waiter([&](bool wasExpired) { wasExpired ? ++expired : ++cancelled; });
+   loop.Schedule(waiter, clock::now() + std::chrono::seconds(100));
+   EXPECT_TRUE(waiter.Pending());
+   EXPECT_TRUE(loop.Cancel(waiter));
+   EXPECT_FALSE(loop.Cancel(waiter));
+   EXPECT_EQ(0, cancelled); // deferred to the loop
+
+   StopWatch sw;
+   loop.Run();
+   EXPECT_LT(sw.ElapsedMs(), 1000u);
+   EXPECT_EQ(0, expired);
+   EXPECT_EQ(1, cancelled);
+   EXPECT_FALSE(waiter.Pending());
+}
+
+TEST_F(TimerLoopTest, RescheduleMovesDeadline) {
+   TimerLoop loop;
+   int wakes = 0;
+   TimerLoop::Callback waiter([&](bool) { ++wakes; });
+   loop.Schedule(waiter, clock::now() + std::chrono::seconds(100));
+   loop.Schedule(waiter, clock::now() + milliseconds(1));
+   EXPECT_EQ(1u, loop.PendingCount());
+   StopWatch sw;
+   loop.Run();
+   EXPECT_LT(sw.ElapsedMs(), 1000u);
+   EXPECT_EQ(1, wakes);
+}
+
+TEST_F(TimerLoopTest, DestroyedWaiterIsRemoved) {
+   TimerLoop loop;
+   {
+      TimerLoop::Callback waiter([](bool) { FAIL(); });
+      loop.Schedule(waiter, clock::now() + milliseconds(1));
+   }
+   EXPECT_EQ(0u, loop.PendingCount());
+}
+
+TEST_F(TimerLoopTest, PeriodicReschedulingFromCallback) {
+   TimerLoop loop;
+   loop.Reserve(1);
+   int ticks = 0;
+   TimerLoop::Callback* self = nullptr;
+   TimerLoop::Callback periodic([&](bool) {
+      if (++ticks < 5) {
+         loop.Schedule(*self, clock::now() + milliseconds(1));
+      }
+   });
+   self = &periodic;
+   loop.Schedule(periodic, clock::now());
+   loop.Run();
+   EXPECT_EQ(5, ticks);
+}
+
+TEST_F(TimerLoopTest, StopFromOtherThread) {
+   TimerLoop loop;
+   TimerLoop::Callback waiter([](bool) {});
+   loop.Schedule(waiter, clock::now() + std::chrono::seconds(100));
+   std::thread stopper([&] {
+      std::this_thread::sleep_for(milliseconds(5));
+      loop.Stop();
+   });
+   StopWatch sw;
+   loop.Run();
+   stopper.join();
+   EXPECT_LT(sw.ElapsedMs(), 1000u);
+   EXPECT_TRUE(waiter.Pending());
+}
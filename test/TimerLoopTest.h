@@ -0,0 +1,22 @@
+/*
+ * File:   TimerLoopTest.h
+ *
+ */
+
+#pragma once
+#include "gtest/gtest.h"
+
+class TimerLoopTest : public ::testing::Test {
+public:
+
+   TimerLoopTest() {
+   };
+protected:
+
+   virtual void SetUp() {
+   };
+
+   virtual void TearDown() {
+   };
+private:
+};
@@ -1,6 +1,10 @@
 #include "ToolsTestStopWatch.h"
 #include "StopWatch.h"
 #include "ThreadSafeStopWatch.h"
+#include "TscClock.h"
+#include "VirtualClock.h"
+#include "MockStopWatch.h"
+#include "WallClockConverter.h"
 #include <chrono>
 #include <thread>
 
@@ -145,3 +149,157 @@ TEST_F(ToolsTestStopWatch, ThreadSafeSecBasicTest) {
    }
    threads.clear();
 }
+
+
+/* TscClock tests */
+TEST_F(ToolsTestStopWatch, TscClockFollowsSteadyClock) {
+   EXPECT_GT(TscClock::TicksPerSecond(), 0);
+   StopWatch steady;
+   TscStopWatch tsc;
+   std::this_thread::sleep_for(std::chrono::milliseconds(50));
+   auto tscUs = tsc.ElapsedUs();
+   auto steadyUs = steady.ElapsedUs();
+   EXPECT_NEAR(static_cast<double>(steadyUs), static_cast<double>(tscUs), steadyUs * 0.02 + 100);
+}
+
+TEST_F(ToolsTestStopWatch, TscClockIsMonotonic) {
+   auto previous = TscClock::now();
+   for (int i = 0; i < 100000; ++i) {
+      auto now = TscClock::now();
+      ASSERT_TRUE(now >= previous);
+      previous = now;
+   }
+}
+
+
+/* WallClockConverter tests */
+namespace {
+   int64_t SystemNowNs() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+   }
+
+   // A wall clock the test steps and drifts, against VirtualClock
+   struct SteppedWallClock {
+      typedef std::chrono::nanoseconds duration;
+      typedef duration::rep rep;
+      typedef duration::period period;
+      typedef std::chrono::time_point<SteppedWallClock> time_point;
+      static const bool is_steady = false;
+
+      static time_point now() { return time_point(duration(mNowNs)); }
+      static int64_t mNowNs;
+   };
+   int64_t SteppedWallClock::mNowNs = 0;
+
+   typedef WallClockConverter<VirtualClock, SteppedWallClock> SteppedConverter;
+
+   // both clocks move by a second, the wall clock driftPpm faster
+   void AdvanceSecond(int64_t driftPpm) {
+      VirtualClock::Advance(std::chrono::seconds(1));
+      SteppedWallClock::mNowNs += 1000000000LL + driftPpm * 1000;
+   }
+}
+
+TEST_F(ToolsTestStopWatch, WallClockFromSteadyClock) {
+   WallClockConverter<std::chrono::steady_clock> toWall;
+   const int64_t before = SystemNowNs();
+   const int64_t converted = toWall.ToUtcNs(std::chrono::steady_clock::now());
+   const int64_t after = SystemNowNs();
+   const int64_t slack = 1000000; // 1 ms
+   EXPECT_GE(converted, before - slack);
+   EXPECT_LE(converted, after + slack);
+   EXPECT_LT(toWall.EstimatedError().count(), slack);
+}
+
+TEST_F(ToolsTestStopWatch, WallClockFromTscClockAfterResync) {
+   WallClockConverter<TscClock> toWall(std::chrono::milliseconds(0));
+   std::this_thread::sleep_for(std::chrono::milliseconds(20));
+   toWall.Resync();
+   EXPECT_NEAR(1.0, toWall.Rate(), 2 * 500e-6 + 1e-12); // the rate plus the slew
+   const int64_t before = SystemNowNs();
+   const int64_t converted = toWall.ToUtcNs(TscClock::now());
+   const int64_t after = SystemNowNs();
+   EXPECT_GE(converted, before - 1000000);
+   EXPECT_LE(converted, after + 1000000);
+}
+
+TEST_F(ToolsTestStopWatch, WallClockOrderIsKept) {
+   WallClockConverter<> toWall;
+   auto first = std::chrono::steady_clock::now();
+   auto second = first + std::chrono::microseconds(5);
+   EXPECT_GT(toWall.ToUtcNs(second), toWall.ToUtcNs(first));
+   auto wall = toWall.ToSystemTime(first);
+   EXPECT_LT(std::chrono::system_clock::now() - wall, std::chrono::seconds(1));
+}
+
+TEST_F(ToolsTestStopWatch, WallClockIsMonotonicAcrossResync) {
+   SteppedWallClock::mNowNs = 1600000000LL * 1000000000LL;
+   SteppedConverter toWall(std::chrono::milliseconds(0));
+   int64_t previous = toWall.ToUtcNs(VirtualClock::now());
+   for (int second = 0; second < 20; ++second) {
+      AdvanceSecond(200); // the wall clock runs 200 ppm fast
+      const VirtualClock::time_point now = VirtualClock::now();
+      const int64_t before = toWall.ToUtcNs(now);
+      toWall.Resync();
+      const int64_t after = toWall.ToUtcNs(now);
+      EXPECT_EQ(before, after) << "the mapping is continuous at the resync, second " << second;
+      EXPECT_GT(toWall.ToUtcNs(now + std::chrono::nanoseconds(1)), previous);
+      previous = after;
+   }
+   // the rate has converged on the drift, and the offset is slewed away
+   EXPECT_NEAR(1.0 + 200e-6, toWall.Rate(), 1e-6);
+   AdvanceSecond(200);
+   EXPECT_NEAR(SteppedWallClock::mNowNs, toWall.ToUtcNs(VirtualClock::now()), 1000);
+}
+
+TEST_F(ToolsTestStopWatch, WallClockStepIsNotSlewedAndKeepsTheRate) {
+   SteppedWallClock::mNowNs = 1600000000LL * 1000000000LL;
+   SteppedConverter toWall(std::chrono::milliseconds(0));
+   AdvanceSecond(0);
+   toWall.Resync();
+   AdvanceSecond(0);
+   toWall.Resync();
+   EXPECT_DOUBLE_EQ(1.0, toWall.Rate());
+
+   // a step back of 5 s is applied at once, conversions go backwards
+   const int64_t beforeStep = toWall.ToUtcNs(VirtualClock::now());
+   AdvanceSecond(0);
+   SteppedWallClock::mNowNs -= 5000000000LL;
+   toWall.Resync();
+   EXPECT_EQ(SteppedWallClock::mNowNs, toWall.ToUtcNs(VirtualClock::now()));
+   EXPECT_LT(toWall.ToUtcNs(VirtualClock::now()), beforeStep);
+   EXPECT_EQ(5000000000LL, toWall.EstimatedError().count());
+
+   // the step does not pin the rate at the clamp
+   EXPECT_DOUBLE_EQ(1.0, toWall.Rate());
+   AdvanceSecond(0);
+   toWall.Resync();
+   EXPECT_DOUBLE_EQ(1.0, toWall.Rate());
+   EXPECT_EQ(SteppedWallClock::mNowNs, toWall.ToUtcNs(VirtualClock::now()));
+}
+
+TEST_F(ToolsTestStopWatch, VirtualClockOnlyMovesWhenAdvanced) {
+   VirtualStopWatch watch;
+   EXPECT_EQ(0u, watch.ElapsedNs());
+   VirtualClock::Advance(std::chrono::milliseconds(1500));
+   EXPECT_EQ(1500u, watch.ElapsedMs());
+   EXPECT_EQ(1u, watch.ElapsedSec());
+
+   VirtualClock::Advance(std::chrono::seconds(-1));
+   EXPECT_EQ(1500u, watch.ElapsedMs());
+
+   auto target = VirtualClock::now() + std::chrono::microseconds(250);
+   EXPECT_EQ(target, VirtualClock::AdvanceTo(target));
+   VirtualClock::AdvanceTo(target - std::chrono::microseconds(100));
+   EXPECT_EQ(1500250u, watch.ElapsedUs());
+
+   watch.Restart();
+   EXPECT_EQ(0u, watch.ElapsedNs());
+}
+
+TEST_F(ToolsTestStopWatch, MockStopWatchSubSecondWarp) {
+   MockStopWatch watch;
+   watch.SetTimeForward(std::chrono::milliseconds(-250));
+   EXPECT_GE(watch.ElapsedMs(), 250u);
+   EXPECT_LT(watch.ElapsedMs(), 1000u);
+}